@@ -0,0 +1,286 @@
+// Times the modules' process() on fixed patches, and checks their outputs against a golden run.
+//
+//   bench [--scenarios a,b] [--rates 44100,96000] [--channels 1,4,16] [--seconds 5]
+//   bench --golden-write FILE   record output hashes, at the first rate
+//   bench --golden-check FILE   compare against a recording, exits 1 on any difference
+#include "host.hpp"
+#include <chrono>
+#include <map>
+#include <fstream>
+#include <sstream>
+
+//block size for timing and golden hashes
+const int BLOCK = 64;
+
+//0V / 10V square wave, starting high
+static float square(int64_t frame, float sampleRate, float hz){
+	return std::fmod(frame * hz / sampleRate, 1.f) < 0.5f ? 10.f : 0.f;
+}
+
+//-1V to 1V triangle
+static float triangle(int64_t frame, float sampleRate, float hz){
+	float phase = std::fmod(frame * hz / sampleRate, 1.f);
+	return 4.f * std::fabs(phase - 0.5f) - 1.f;
+}
+
+//a patch to run: what to add and connect, and what to drive into it every sample
+struct Scenario {
+	const char* name;
+	void (*setup)(Host& host, int channels);
+	void (*drive)(Host& host, int channels);
+	//outputs to hash for the golden comparison, all of the first module's
+	int numOutputs;
+};
+
+//every output of a node goes to an input of a later node, so trigs run through the whole grid.
+//poly gates on a few nodes, and the router's channels set to match
+static void setupNetwork(Host& host, const char* slug, int rows, int cols, int channels, const char* extra){
+	NetworkIds ids(rows, cols);
+	std::string json = string::f("{\"channels\": %d%s}", channels, extra);
+	Module* m = host.add(slug, json.c_str());
+	for(int node = 0; node < ids.nodes; node++){
+		m->params[ids.valParam(node)].setValue((node * 37 % 100) / 100.f);
+		for(int out = 0; out < 4; out++)
+			host.connect(m, ids.trigOutput(node, out), m, ids.trigInput((node + out + 1) % ids.nodes, 1));
+	}
+	host.plug(m, ids.cvOutput());
+	host.plug(m, ids.gateOutput());
+	host.plug(m, ids.retrigOutput());
+}
+
+static void driveNetwork(Host& host, int nodes, int channels){
+	NetworkIds ids(nodes / 4, 4);
+	Module* m = host.modules[0];
+	float gates[16];
+	for(int n = 0; n < 3; n++){
+		int node = n * nodes / 3;
+		for(int c = 0; c < channels; c++)
+			gates[c] = square(host.frame, host.args.sampleRate, 4.f * (n + 1) + c * 0.5f);
+		Host::drive(m, ids.trigInput(node, 0), gates, channels);
+	}
+}
+
+static Scenario scenarios[] = {
+	{"network",
+		[](Host& host, int channels){ setupNetwork(host, "Network", 4, 4, channels, ""); },
+		[](Host& host, int channels){ driveNetwork(host, 16, channels); },
+		NetworkIds(4, 4).numOutputs()},
+	{"network4x8",
+		[](Host& host, int channels){ setupNetwork(host, "Network4x8", 4, 8, channels, ""); },
+		[](Host& host, int channels){ driveNetwork(host, 32, channels); },
+		NetworkIds(4, 8).numOutputs()},
+	{"network-glide",
+		[](Host& host, int channels){ setupNetwork(host, "Network", 4, 4, channels, ", \"quantizeMode\": 1, \"glideTime\": 50"); },
+		[](Host& host, int channels){ driveNetwork(host, 16, channels); },
+		NetworkIds(4, 4).numOutputs()},
+	{"nexus",
+		[](Host& host, int channels){
+			Module* m = host.add("Nexus");
+			for(int i = 0; i < nexus::NUM_OUTPUTS; i++)
+				host.plug(m, i);
+		},
+		[](Host& host, int channels){
+			float gates[16];
+			for(int c = 0; c < channels; c++)
+				gates[c] = square(host.frame, host.args.sampleRate, 20.f + c);
+			Host::drive(host.modules[0], nexus::trigInput(0), gates, channels);
+			float reset = square(host.frame, host.args.sampleRate, 0.3f) > 0.f ? 0.f : 10.f;
+			Host::drive(host.modules[0], nexus::resetInput(0), &reset, 1);
+		},
+		nexus::NUM_OUTPUTS},
+	{"nexus-independent",
+		[](Host& host, int channels){
+			Module* m = host.add("Nexus", "{\"independentChannels\": true}");
+			for(int i = 0; i < nexus::NUM_OUTPUTS; i++)
+				host.plug(m, i);
+		},
+		[](Host& host, int channels){
+			float gates[16];
+			for(int c = 0; c < channels; c++)
+				gates[c] = square(host.frame, host.args.sampleRate, 20.f + c);
+			Host::drive(host.modules[0], nexus::trigInput(0), gates, channels);
+		},
+		nexus::NUM_OUTPUTS},
+	{"quantizer",
+		[](Host& host, int channels){
+			Module* m = host.add("Quantizer");
+			host.plug(m, quantizer::CV_OUTPUT);
+			host.plug(m, quantizer::TRIG_OUTPUT);
+		},
+		[](Host& host, int channels){
+			float cv[16];
+			for(int c = 0; c < channels; c++)
+				cv[c] = 2.f * triangle(host.frame, host.args.sampleRate, 0.5f + c * 0.1f);
+			Host::drive(host.modules[0], quantizer::CV_INPUT, cv, channels);
+		},
+		quantizer::NUM_OUTPUTS},
+};
+
+//fnv-1a over everything a cable would carry: channel counts, and voltages of the channels present
+static uint64_t hashOutputs(Module* m, int numOutputs, uint64_t hash){
+	auto add = [&](const void* data, size_t size){
+		for(size_t i = 0; i < size; i++){
+			hash ^= ((const uint8_t*) data)[i];
+			hash *= 0x100000001b3ULL;
+		}
+	};
+	for(int i = 0; i < numOutputs; i++){
+		Output& out = m->outputs[i];
+		add(&out.channels, sizeof(out.channels));
+		add(out.voltages, out.channels * sizeof(float));
+	}
+	return hash;
+}
+
+static std::vector<std::string> split(const std::string& s){
+	std::vector<std::string> items;
+	std::stringstream ss(s);
+	std::string item;
+	while(std::getline(ss, item, ','))
+		items.push_back(item);
+	return items;
+}
+
+//one hash per block of samples
+static std::vector<uint64_t> runGolden(Scenario& scenario, float rate, int channels, float seconds){
+	Host host(rate);
+	scenario.setup(host, channels);
+	int64_t frames = (int64_t) (seconds * rate) / BLOCK * BLOCK;
+	std::vector<uint64_t> hashes;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for(int64_t f = 0; f < frames; f++){
+		scenario.drive(host, channels);
+		host.step();
+		hash = hashOutputs(host.modules[0], scenario.numOutputs, hash);
+		if((f + 1) % BLOCK == 0){
+			hashes.push_back(hash);
+			hash = 0xcbf29ce484222325ULL;
+		}
+	}
+	return hashes;
+}
+
+static void runTimed(Scenario& scenario, float rate, int channels, float seconds){
+	Host host(rate);
+	scenario.setup(host, channels);
+	//settle, and get caches and branch predictors warm
+	for(int f = 0; f < rate / 10; f++){
+		scenario.drive(host, channels);
+		host.step();
+	}
+
+	int64_t blocks = (int64_t) (seconds * rate) / BLOCK;
+	std::vector<double> times;
+	times.reserve(blocks);
+	double total = 0.0;
+	for(int64_t b = 0; b < blocks; b++){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < BLOCK; f++){
+			scenario.drive(host, channels);
+			host.step();
+		}
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - start).count() / BLOCK;
+		times.push_back(ns);
+		total += ns;
+	}
+	std::sort(times.begin(), times.end());
+	auto percentile = [&](double p){ return times[std::min((size_t) (p * times.size()), times.size() - 1)]; };
+	std::printf("%-18s %7.0f %3d %10.1f %8.1f %8.1f %8.1f %8.1f\n",
+		scenario.name, rate, channels, total / blocks,
+		percentile(0.5), percentile(0.9), percentile(0.99), times.back());
+}
+
+int main(int argc, char** argv){
+	std::vector<std::string> names;
+	std::vector<float> rates = {44100.f, 96000.f, 192000.f};
+	std::vector<int> channelCounts = {1, 4, 16};
+	float seconds = 5.f;
+	std::string goldenWrite, goldenCheck;
+
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : "";
+		if(arg == "--scenarios") names = split(value);
+		else if(arg == "--rates"){ rates.clear(); for(auto& r : split(value)) rates.push_back(std::atof(r.c_str())); }
+		else if(arg == "--channels"){ channelCounts.clear(); for(auto& c : split(value)) channelCounts.push_back(clamp(std::atoi(c.c_str()), 1, 16)); }
+		else if(arg == "--seconds") seconds = std::atof(value);
+		else if(arg == "--golden-write") goldenWrite = value;
+		else if(arg == "--golden-check") goldenCheck = value;
+		else{
+			std::printf("usage: %s [--scenarios a,b] [--rates 44100,96000] [--channels 1,4,16] [--seconds 5]\n"
+				"       [--golden-write FILE | --golden-check FILE]\nscenarios:", argv[0]);
+			for(Scenario& s : scenarios) std::printf(" %s", s.name);
+			std::printf("\n");
+			return arg == "--help" ? 0 : 2;
+		}
+		i++;
+	}
+
+	std::vector<Scenario*> selected;
+	for(Scenario& s : scenarios)
+		if(names.empty() || std::find(names.begin(), names.end(), s.name) != names.end())
+			selected.push_back(&s);
+
+	if(goldenWrite.empty() && goldenCheck.empty()){
+		std::printf("%-18s %7s %3s %10s %8s %8s %8s %8s\n", "scenario", "rate", "ch", "ns/sample", "p50", "p90", "p99", "max");
+		for(Scenario* s : selected)
+			for(float rate : rates)
+				for(int channels : channelCounts)
+					runTimed(*s, rate, channels, seconds);
+		return 0;
+	}
+
+	//golden runs are short and at one rate, they're about behaviour not speed
+	float rate = rates.empty() ? 44100.f : rates[0];
+	if(not goldenWrite.empty()){
+		std::ofstream file(goldenWrite);
+		for(Scenario* s : selected)
+			for(int channels : channelCounts){
+				std::vector<uint64_t> hashes = runGolden(*s, rate, channels, seconds);
+				file << s->name << " " << rate << " " << channels << " " << hashes.size();
+				for(uint64_t h : hashes) file << " " << std::hex << h << std::dec;
+				file << "\n";
+			}
+		return 0;
+	}
+
+	std::map<std::string, std::vector<uint64_t>> golden;
+	std::ifstream file(goldenCheck);
+	if(!file){
+		std::fprintf(stderr, "can't read %s\n", goldenCheck.c_str());
+		return 2;
+	}
+	std::string line;
+	while(std::getline(file, line)){
+		std::stringstream ss(line);
+		std::string name, r, channels;
+		size_t count;
+		ss >> name >> r >> channels >> count;
+		std::vector<uint64_t>& hashes = golden[name + " " + r + " " + channels];
+		hashes.resize(count);
+		for(uint64_t& h : hashes) ss >> std::hex >> h;
+	}
+
+	int failures = 0;
+	for(Scenario* s : selected)
+		for(int channels : channelCounts){
+			std::string key = string::f("%s %g %d", s->name, rate, channels);
+			auto it = golden.find(key);
+			if(it == golden.end()){
+				std::printf("%-30s not in %s\n", key.c_str(), goldenCheck.c_str());
+				failures++;
+				continue;
+			}
+			std::vector<uint64_t> hashes = runGolden(*s, rate, channels, seconds);
+			size_t n = std::min(hashes.size(), it->second.size());
+			size_t b = 0;
+			while(b < n && hashes[b] == it->second[b]) b++;
+			if(b < n){
+				std::printf("%-30s differs from sample %zu (%.4fs)\n", key.c_str(), b * BLOCK, b * BLOCK / rate);
+				failures++;
+			}
+			else std::printf("%-30s ok, %zu samples\n", key.c_str(), n * BLOCK);
+		}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+// Just enough of Rack's engine to run the plugin's modules: cables, expanders and the sample loop.
+// Modules are created from the plugin's models by slug and set up through their json, like a preset.
+#pragma once
+#include "plugin.hpp"
+#include <stdexcept>
+
+void init(Plugin* p);
+
+//port and param ids by module, these follow the enums in src/
+struct NetworkIds {
+	int nodes;
+	int bypasses;
+	NetworkIds(int rows, int cols) : nodes(rows * cols), bypasses((rows + 1) / 2) {}
+	int valParam(int node){ return node; }
+	int bypassParam(int n){ return nodes + n; }
+	int attenuversionParam(){ return nodes + bypasses; }
+	int bipolarParam(){ return nodes + bypasses + 1; }
+	int resetParam(){ return nodes + bypasses + 2; }
+	int trigInput(int node, int in){ return node * 2 + in; }
+	int attenuversionInput(){ return nodes * 2; }
+	int resetInput(int n){ return nodes * 2 + 1 + n; }
+	int sceneInput(){ return nodes * 2 + 7; }
+	int sceneTrigInput(){ return nodes * 2 + 8; }
+	int trigOutput(int node, int out){ return node * 4 + out; }
+	int cvOutput(){ return nodes * 4; }
+	int gateOutput(){ return nodes * 4 + 1; }
+	int retrigOutput(){ return nodes * 4 + 2; }
+	int numOutputs(){ return nodes * 4 + 3; }
+};
+
+namespace nexus {
+	const int NUM_STAGES = 6;
+	inline int repsParam(int stage){ return stage; }
+	const int RESET_PARAM = 6;
+	inline int trigInput(int stage){ return stage; }
+	inline int resetInput(int n){ return 6 + n; }
+	const int SEEK_INPUT = 8;
+	inline int trigOutput(int stage){ return stage; }
+	inline int nextOutput(int stage){ return 6 + stage; }
+	const int STEP_OUTPUT = 12;
+	const int NUM_OUTPUTS = 13;
+}
+
+namespace quantizer {
+	const int ROOT_PARAM = 0;
+	const int MODE_PARAM = 1;
+	const int CV_INPUT = 0;
+	const int ROOT_INPUT = 1;
+	const int MODE_INPUT = 2;
+	const int CV_OUTPUT = 0;
+	const int TRIG_OUTPUT = 1;
+	const int NUM_OUTPUTS = 2;
+}
+
+struct Host {
+	struct HostCable {
+		Module* from;
+		int outputId;
+		Module* to;
+		int inputId;
+	};
+
+	Plugin plugin;
+	std::vector<Module*> modules;
+	std::vector<HostCable> cables;
+	Module::ProcessArgs args;
+	int64_t frame = 0;
+
+	Host(float sampleRate){
+		init(&plugin);
+		args.sampleRate = sampleRate;
+		args.sampleTime = 1.f / sampleRate;
+	}
+
+	~Host(){
+		//models are the plugin's globals, they outlive the host
+		for(Module* m : modules)
+			delete m;
+	}
+
+	Model* getModel(const std::string& slug){
+		for(Model* model : plugin.models)
+			if(model->slug == slug) return model;
+		throw std::runtime_error("no module " + slug);
+	}
+
+	//new module to the right of the last one added, so neighbours see each other as expanders
+	Module* add(const std::string& slug, const char* json = nullptr){
+		Module* m = getModel(slug)->createModule();
+		m->id = modules.size();
+		if(not modules.empty()){
+			Module* left = modules.back();
+			left->rightExpander.module = m;
+			left->rightExpander.moduleId = m->id;
+			m->leftExpander.module = left;
+			m->leftExpander.moduleId = left->id;
+		}
+		modules.push_back(m);
+		m->onAdd();
+		m->onSampleRateChange();
+		if(json){
+			json_t* rootJ = parseJson(json);
+			m->dataFromJson(rootJ);
+			json_decref(rootJ);
+		}
+		return m;
+	}
+
+	//ports with a cable start at 1 channel, the module sets more if it wants
+	void connect(Module* from, int outputId, Module* to, int inputId){
+		cables.push_back({from, outputId, to, inputId});
+		if(from->outputs[outputId].channels == 0) from->outputs[outputId].channels = 1;
+		if(to->inputs[inputId].channels == 0) to->inputs[inputId].channels = 1;
+	}
+
+	//an output patched to something outside the host, e.g. a recorder
+	void plug(Module* from, int outputId){
+		if(from->outputs[outputId].channels == 0) from->outputs[outputId].channels = 1;
+	}
+
+	//set a driven input for this sample, as if a cable from another module carried it
+	static void drive(Module* to, int inputId, const float* voltages, int channels){
+		Input& in = to->inputs[inputId];
+		in.channels = channels;
+		std::copy(voltages, voltages + channels, in.voltages);
+	}
+
+	//one sample, in the order Rack's engine steps: cables, modules, expander messages
+	void step(){
+		for(const HostCable& c : cables){
+			Output& out = c.from->outputs[c.outputId];
+			Input& in = c.to->inputs[c.inputId];
+			std::copy(out.voltages, out.voltages + 16, in.voltages);
+			in.channels = out.channels;
+		}
+		for(Module* m : modules)
+			m->process(args);
+		for(Module* m : modules){
+			for(Module::Expander* e : {&m->leftExpander, &m->rightExpander}){
+				if(e->messageFlipRequested){
+					std::swap(e->producerMessage, e->consumerMessage);
+					e->messageFlipRequested = false;
+				}
+			}
+		}
+		frame++;
+	}
+
+	//flat json objects of numbers and booleans, enough to set up a module
+	static json_t* parseJson(const char* s){
+		json_t* rootJ = json_object();
+		const char* p = s;
+		while((p = std::strchr(p, '"'))){
+			const char* end = std::strchr(p + 1, '"');
+			if(!end) break;
+			std::string key(p + 1, end);
+			const char* value = std::strchr(end, ':');
+			if(!value) break;
+			value++;
+			while(*value == ' ') value++;
+			json_t* valueJ;
+			if(std::strncmp(value, "true", 4) == 0) valueJ = json_boolean(true);
+			else if(std::strncmp(value, "false", 5) == 0) valueJ = json_boolean(false);
+			else if(std::strpbrk(std::string(value, std::strcspn(value, ",}")).c_str(), ".eE")) valueJ = json_real(std::atof(value));
+			else valueJ = json_integer(std::atoll(value));
+			json_object_set_new(rootJ, key.c_str(), valueJ);
+			p = value + std::strcspn(value, ",}");
+		}
+		return rootJ;
+	}
+};
@@ -0,0 +1,7 @@
+// Stand-in for osdialog, declared only. File dialogs are ui code and never run here.
+#pragma once
+typedef enum { OSDIALOG_OPEN, OSDIALOG_OPEN_DIR, OSDIALOG_SAVE } osdialog_file_action;
+typedef struct osdialog_filters osdialog_filters;
+char* osdialog_file(osdialog_file_action action, const char* path, const char* filename, osdialog_filters* filters);
+osdialog_filters* osdialog_filters_parse(const char* str);
+void osdialog_filters_free(osdialog_filters* filters);
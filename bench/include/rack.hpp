@@ -0,0 +1,323 @@
+// Stand-in for the parts of the Rack v1 SDK the modules use, so their engine code
+// builds and runs outside Rack. Params, ports, lights, expanders, simd, dsp and json work
+// like Rack's; widgets, windows and menus are declared only, since nothing here draws.
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <smmintrin.h>
+
+//json, as much of jansson as the modules use. object_get and array_get return borrowed references
+struct json_t {
+	enum Type {OBJECT, ARRAY, STRING, INTEGER, REAL, BOOL_TRUE, BOOL_FALSE} type;
+	std::vector<std::pair<std::string, json_t*>> items;
+	std::string text;
+	long long integer = 0;
+	double real = 0.0;
+	json_t(Type type) : type(type) {}
+	~json_t() { for (auto& item : items) delete item.second; }
+};
+inline json_t* json_object() { return new json_t(json_t::OBJECT); }
+inline json_t* json_array() { return new json_t(json_t::ARRAY); }
+inline json_t* json_integer(long long i) { json_t* j = new json_t(json_t::INTEGER); j->integer = i; return j; }
+inline json_t* json_real(double r) { json_t* j = new json_t(json_t::REAL); j->real = r; return j; }
+inline json_t* json_boolean(bool b) { return new json_t(b ? json_t::BOOL_TRUE : json_t::BOOL_FALSE); }
+inline json_t* json_string(const char* s) { json_t* j = new json_t(json_t::STRING); j->text = s; return j; }
+inline void json_decref(json_t* j) { delete j; }
+inline json_t* json_object_get(const json_t* j, const char* key) {
+	if (!j || j->type != json_t::OBJECT) return nullptr;
+	for (auto& item : j->items) if (item.first == key) return item.second;
+	return nullptr;
+}
+inline int json_object_set_new(json_t* j, const char* key, json_t* value) {
+	for (auto& item : j->items) if (item.first == key) { delete item.second; item.second = value; return 0; }
+	j->items.push_back({key, value});
+	return 0;
+}
+inline int json_array_append_new(json_t* j, json_t* value) { j->items.push_back({"", value}); return 0; }
+inline size_t json_array_size(const json_t* j) { return j && j->type == json_t::ARRAY ? j->items.size() : 0; }
+inline json_t* json_array_get(const json_t* j, size_t i) { return i < json_array_size(j) ? j->items[i].second : nullptr; }
+inline long long json_integer_value(const json_t* j) { return j && j->type == json_t::INTEGER ? j->integer : 0; }
+inline double json_real_value(const json_t* j) { return j && j->type == json_t::REAL ? j->real : 0.0; }
+inline double json_number_value(const json_t* j) { return j && j->type == json_t::INTEGER ? j->integer : json_real_value(j); }
+inline bool json_is_true(const json_t* j) { return j && j->type == json_t::BOOL_TRUE; }
+inline const char* json_string_value(const json_t* j) { return j && j->type == json_t::STRING ? j->text.c_str() : nullptr; }
+#define json_boolean_value json_is_true
+
+struct NVGcolor { float r, g, b, a; };
+struct NVGcontext;
+NVGcolor nvgRGB(int, int, int); NVGcolor nvgRGBA(int, int, int, int);
+void nvgSave(NVGcontext*); void nvgRestore(NVGcontext*); void nvgFontSize(NVGcontext*, float); void nvgFontFaceId(NVGcontext*, int);
+void nvgTextLetterSpacing(NVGcontext*, float); void nvgFillColor(NVGcontext*, NVGcolor); void nvgTextBox(NVGcontext*, float, float, float, const char*, const char*);
+void nvgBeginPath(NVGcontext*); void nvgCircle(NVGcontext*, float, float, float); void nvgFill(NVGcontext*); void nvgTextAlign(NVGcontext*, int); float nvgText(NVGcontext*, float, float, const char*, const char*);
+#define NVG_ALIGN_CENTER 2
+#define NVG_ALIGN_MIDDLE 16
+#define BND_WIDGET_HEIGHT 21
+#define CHECKMARK_STRING "✔"
+#define CHECKMARK(_cond) ((_cond) ? CHECKMARK_STRING : "")
+#define RIGHT_ARROW "▸"
+#define ENUMS(name, count) name, name ## _LAST = name + (count) - 1
+#define RACK_GRID_WIDTH 15
+#define RACK_GRID_HEIGHT 380
+#define WARN(format, ...) fprintf(stderr, "[warn] " format "\n", ##__VA_ARGS__)
+
+namespace rack {
+namespace string {
+inline std::string f(const char* format, ...) {
+	char buf[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	return buf;
+}
+inline std::string filename(const std::string& path) { size_t pos = path.find_last_of("/\\"); return pos == std::string::npos ? path : path.substr(pos + 1); }
+}
+namespace random {
+//fixed seed, so runs can be compared sample by sample
+inline std::mt19937& engine() { static std::mt19937 e(1); return e; }
+inline uint32_t u32() { return engine()(); }
+inline float uniform() { return (engine()() >> 8) * (1.f / (1 << 24)); }
+}
+namespace math {
+inline float clamp(float x, float a, float b) { return std::fmax(std::fmin(x, b), a); }
+inline int clamp(int x, int a, int b) { return std::max(std::min(x, b), a); }
+inline float rescale(float x, float xMin, float xMax, float yMin, float yMax) { return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin); }
+inline int eucMod(int a, int b) { int m = a % b; return m < 0 ? m + b : m; }
+struct Vec { float x = 0, y = 0; Vec() {} Vec(float x, float y) : x(x), y(y) {} Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); } };
+struct Rect { Vec pos, size; };
+}
+using namespace math;
+
+namespace simd {
+struct float_4 {
+	__m128 v;
+	float_4() = default;
+	float_4(__m128 v) : v(v) {}
+	float_4(float x) : v(_mm_set1_ps(x)) {}
+	float_4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+	static float_4 load(const float* x) { return _mm_loadu_ps(x); }
+	void store(float* x) { _mm_storeu_ps(x, v); }
+	static float_4 zero() { return _mm_setzero_ps(); }
+	static float_4 mask() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	float& operator[](int i) { return ((float*) &v)[i]; }
+	const float& operator[](int i) const { return ((const float*) &v)[i]; }
+};
+inline float_4 operator+(float_4 a, float_4 b) { return _mm_add_ps(a.v, b.v); }
+inline float_4 operator-(float_4 a, float_4 b) { return _mm_sub_ps(a.v, b.v); }
+inline float_4 operator*(float_4 a, float_4 b) { return _mm_mul_ps(a.v, b.v); }
+inline float_4 operator/(float_4 a, float_4 b) { return _mm_div_ps(a.v, b.v); }
+inline float_4 operator-(float_4 a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+inline float_4 operator&(float_4 a, float_4 b) { return _mm_and_ps(a.v, b.v); }
+inline float_4 operator|(float_4 a, float_4 b) { return _mm_or_ps(a.v, b.v); }
+inline float_4 operator^(float_4 a, float_4 b) { return _mm_xor_ps(a.v, b.v); }
+inline float_4 operator~(float_4 a) { return _mm_xor_ps(a.v, float_4::mask().v); }
+inline float_4 operator>=(float_4 a, float_4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline float_4 operator<=(float_4 a, float_4 b) { return _mm_cmple_ps(a.v, b.v); }
+inline float_4 operator>(float_4 a, float_4 b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline float_4 operator<(float_4 a, float_4 b) { return _mm_cmplt_ps(a.v, b.v); }
+inline float_4 operator==(float_4 a, float_4 b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline float_4 operator!=(float_4 a, float_4 b) { return _mm_cmpneq_ps(a.v, b.v); }
+inline float_4& operator+=(float_4& a, float_4 b) { return a = a + b; }
+inline float_4& operator-=(float_4& a, float_4 b) { return a = a - b; }
+inline float_4& operator*=(float_4& a, float_4 b) { return a = a * b; }
+inline float_4& operator/=(float_4& a, float_4 b) { return a = a / b; }
+inline float_4& operator&=(float_4& a, float_4 b) { return a = a & b; }
+inline float_4& operator|=(float_4& a, float_4 b) { return a = a | b; }
+inline int movemask(float_4 a) { return _mm_movemask_ps(a.v); }
+inline float_4 ifelse(float_4 m, float_4 a, float_4 b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+inline float_4 floor(float_4 a) { return _mm_floor_ps(a.v); }
+inline float_4 round(float_4 a) { return _mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+inline float_4 fmin(float_4 a, float_4 b) { return _mm_min_ps(a.v, b.v); }
+inline float_4 fmax(float_4 a, float_4 b) { return _mm_max_ps(a.v, b.v); }
+inline float_4 clamp(float_4 x, float_4 a, float_4 b) { return fmin(fmax(x, a), b); }
+inline float_4 abs(float_4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+inline float_4 exp(float_4 a) { return float_4(std::exp(a[0]), std::exp(a[1]), std::exp(a[2]), std::exp(a[3])); }
+inline float_4 crossfade(float_4 a, float_4 b, float_4 p) { return a + (b - a) * p; }
+}
+
+namespace dsp {
+template <typename T = float>
+struct TSchmittTrigger {
+	T state;
+	TSchmittTrigger() { reset(); }
+	void reset() { state = T::mask(); }
+	T process(T in) { T on = (in >= 1.f); T off = (in <= 0.f); T triggered = ~state & on; state = on | (state & ~off); return triggered; }
+	T isHigh() { return state; }
+};
+template <>
+struct TSchmittTrigger<float> {
+	bool state = true;
+	void reset() { state = true; }
+	bool process(float in) { if (state) { if (in <= 0.f) state = false; } else if (in >= 1.f) { state = true; return true; } return false; }
+	bool isHigh() { return state; }
+};
+typedef TSchmittTrigger<> SchmittTrigger;
+struct BooleanTrigger { bool state = true; void reset() { state = true; } bool process(bool s) { bool t = s && !state; state = s; return t; } };
+template <typename T = float> struct TTimer { T time = 0.f; void reset() { time = 0.f; } T process(T dt) { time += dt; return time; } };
+typedef TTimer<> Timer;
+template <typename T = float>
+struct TPulseGenerator {
+	T remaining = 0.f;
+	void reset() { remaining = 0.f; }
+	bool process(float dt) { if (remaining > 0.f) { remaining -= dt; return true; } return false; }
+	void trigger(float duration = 1e-3f) { if (duration > remaining) remaining = duration; }
+};
+typedef TPulseGenerator<> PulseGenerator;
+template <typename T, size_t S>
+struct RingBuffer {
+	T data[S];
+	size_t start = 0, end = 0;
+	void push(T t) { data[end++ % S] = t; }
+	T shift() { return data[start++ % S]; }
+	void clear() { start = end = 0; }
+	bool empty() const { return start == end; }
+	bool full() const { return end - start == S; }
+	size_t size() const { return end - start; }
+};
+}
+
+namespace plugin { struct Model; }
+namespace engine {
+using plugin::Model;
+struct ParamQuantity { float minValue = 0.f, maxValue = 1.f, defaultValue = 0.f; std::string label, unit; float getDisplayValue(); };
+struct Param { float value = 0.f; float getValue() { return value; } void setValue(float v) { value = v; } };
+struct Light {
+	float value = 0.f;
+	void setBrightness(float b) { value = b; }
+	float getBrightness() { return value; }
+	void setSmoothBrightness(float b, float deltaTime) { value += (b - value) * std::min(deltaTime * 60.f, 1.f); }
+};
+struct Port {
+	float voltages[16] = {};
+	int channels = 0;
+	void setVoltage(float v, int c = 0) { voltages[c] = v; }
+	float getVoltage(int c = 0) { return voltages[c]; }
+	float getPolyVoltage(int c) { return channels == 1 ? voltages[0] : voltages[c]; }
+	float getNormalVoltage(float n, int c = 0) { return channels > 0 ? voltages[c] : n; }
+	float* getVoltages(int firstChannel = 0) { return &voltages[firstChannel]; }
+	template <typename T> T getVoltageSimd(int firstChannel) { return T::load(&voltages[firstChannel]); }
+	template <typename T> void setVoltageSimd(T v, int firstChannel) { v.store(&voltages[firstChannel]); }
+	//like Rack, unpatched ports stay at 0 channels and dropped channels are zeroed
+	void setChannels(int c) { if (channels == 0) return; for (int i = c; i < channels; i++) voltages[i] = 0.f; channels = std::max(c, 1); }
+	int getChannels() { return channels; }
+	bool isConnected() { return channels > 0; }
+	bool isMonophonic() { return channels == 1; }
+	bool isPolyphonic() { return channels > 1; }
+};
+struct Output : Port {};
+struct Input : Port {};
+struct Module {
+	int id = -1;
+	Model* model = nullptr;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	std::vector<ParamQuantity> paramQuantities;
+	struct Expander { int moduleId = -1; Module* module = nullptr; void* producerMessage = nullptr; void* consumerMessage = nullptr; bool messageFlipRequested = false; };
+	Expander leftExpander, rightExpander;
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams); inputs.resize(numInputs); outputs.resize(numOutputs); lights.resize(numLights); paramQuantities.resize(numParams);
+	}
+	template <class TParamQuantity = ParamQuantity>
+	void configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string label = "", std::string unit = "", float = 0.f, float = 1.f, float = 0.f) {
+		params[paramId].value = defaultValue;
+		ParamQuantity& pq = paramQuantities[paramId];
+		pq.minValue = minValue; pq.maxValue = maxValue; pq.defaultValue = defaultValue;
+		pq.label = label; pq.unit = unit;
+	}
+	struct ProcessArgs { float sampleRate; float sampleTime; };
+	virtual void process(const ProcessArgs&) {}
+	virtual json_t* dataToJson() { return nullptr; }
+	virtual void dataFromJson(json_t*) {}
+	virtual void onAdd() {}
+	virtual void onRemove() {}
+	virtual void onReset() {}
+	virtual void onRandomize() {}
+	virtual void onSampleRateChange() {}
+	virtual ~Module() {}
+};
+struct Cable { int id; Module* outputModule; int outputId; Module* inputModule; int inputId; };
+}
+using namespace engine;
+
+namespace plugin {
+struct Model {
+	std::string slug;
+	virtual Module* createModule() = 0;
+	virtual ~Model() {}
+};
+struct Plugin { std::vector<Model*> models; void addModel(Model* model) { models.push_back(model); } };
+}
+using namespace plugin;
+
+//ui, declared only
+namespace event { struct Action {}; struct Change {}; }
+namespace widget {
+struct Widget { math::Rect box; std::list<Widget*> children; bool visible = true; struct DrawArgs { NVGcontext* vg; }; virtual void draw(const DrawArgs&) {} virtual void step() {} void addChild(Widget*); void requestDelete(); template <class T> T* getAncestorOfType(); virtual ~Widget() {} };
+struct TransparentWidget : Widget {};
+}
+using namespace widget;
+struct Font { int handle; };
+struct Svg {};
+struct Window { std::shared_ptr<Svg> loadSvg(const std::string&); std::shared_ptr<Font> loadFont(const std::string&); };
+namespace app { struct Scene; }
+struct App { Window* window; app::Scene* scene; };
+extern App* appInstance;
+#define APP appInstance
+namespace asset { std::string plugin(Plugin*, const std::string&); }
+namespace ui {
+struct MenuEntry : Widget {};
+struct MenuSeparator : MenuEntry {};
+struct MenuLabel : MenuEntry { std::string text; };
+struct MenuItem : MenuEntry { std::string text, rightText; bool disabled = false; virtual void onAction(const event::Action&) {} virtual Widget* createChildMenu() { return nullptr; } };
+struct Menu : Widget {};
+struct MenuOverlay : Widget {};
+struct TextField : Widget { std::string text, placeholder; virtual void onAction(const event::Action&) {} };
+}
+using namespace ui;
+namespace app {
+struct ParamWidget : Widget { ParamQuantity* getParamQuantity(); };
+struct Knob : ParamWidget { bool snap = false; float minAngle, maxAngle; };
+struct SvgKnob : Knob { void setSvg(std::shared_ptr<Svg>); };
+struct RoundKnob : SvgKnob {}; struct RoundBlackKnob : RoundKnob {}; struct Trimpot : RoundKnob {};
+struct SvgSwitch : ParamWidget { bool momentary = false; void addFrame(std::shared_ptr<Svg>); };
+struct PortWidget : Widget {}; struct SvgPort : PortWidget { void setSvg(std::shared_ptr<Svg>); }; typedef SvgPort SVGPort; struct PJ301MPort : SvgPort {};
+struct LightWidget : TransparentWidget { NVGcolor bgColor, color, borderColor; };
+struct ModuleLightWidget : LightWidget { void addBaseColor(NVGcolor); virtual void drawLight(const DrawArgs&) {} };
+struct ScrewSilver : Widget {};
+struct CableWidget : Widget { engine::Cable* cable; bool isComplete(); };
+struct RackWidget : Widget { Widget* cableContainer; };
+struct Scene : Widget { RackWidget* rack; };
+struct ModuleWidget : Widget { Module* module = nullptr; void setModule(Module*); void setPanel(std::shared_ptr<Svg>); void addParam(ParamWidget*); void addInput(PortWidget*); void addOutput(PortWidget*); virtual void appendContextMenu(Menu*) {} };
+}
+using namespace app;
+template <class T> T* createWidget(math::Vec);
+template <class T> T* createParamCentered(math::Vec, Module*, int);
+template <class T> T* createInputCentered(math::Vec, Module*, int);
+template <class T> T* createOutputCentered(math::Vec, Module*, int);
+template <class T> T* createLightCentered(math::Vec, Module*, int);
+math::Vec mm2px(math::Vec);
+
+//the widget is never built, modules are created straight from the model
+template <class TModule, class TModuleWidget>
+Model* createModel(const std::string& slug) {
+	struct TModel : Model {
+		Module* createModule() override { TModule* m = new TModule; m->model = this; return m; }
+	};
+	TModel* model = new TModel;
+	model->slug = slug;
+	return model;
+}
+}
@@ -0,0 +1,395 @@
+// Renders a patch of Networks, Nexus and Quantizers as fast as the cpu allows, to csv or wav.
+//
+//   render PATCH -o out.csv [--every-sample]
+//   render PATCH -o out.wav
+//
+// PATCH is a text file, one statement per line, # starts a comment. Modules are numbered from 1
+// in the order they're added and sit side by side, so neighbours chain like they do in Rack.
+//
+//   rate 4000                           sample rate, default 4000
+//   seconds 600                         length, default 60
+//   network 4x4 {"channels": 4}         add a module, 4x2, 4x4 or 4x8. json is set like a preset
+//   nexus {"independentChannels": true}
+//   quantizer
+//   knob 1 node3 0.8                    set a param: nodeN bypassN attenuversion bipolar
+//   knob 2 reps1 8                        repsN for nexus, root mode for quantizer
+//   cable 1 n3.out2 1 n5.in1            output to input, network nodes are nN.inK / nN.outK
+//   clock 1 n1.in1 bpm 120 [ppq 4] [width 0.5] [delay 0] [channels 1]
+//   clock 2 trig1 hz 8                  clocks are 10V pulse trains, every input can have its own
+//   trigger 1 reset1 0.5                a 1ms trigger at a time in seconds
+//   voltage 1 scene 2.5                 a constant voltage
+//   record 1 cv                         outputs to write, default is each module's main outputs
+//
+// csv has a column per channel of every recorded output, and by default only the rows where
+// something changed. wav is 32 bit float, one wav channel per csv column, every sample.
+#include "host.hpp"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <map>
+
+struct PatchModule {
+	Module* module;
+	std::string type;
+	NetworkIds ids{4, 4};
+};
+
+struct Source {
+	PatchModule* pm;
+	int inputId;
+	int channels = 1;
+	//clock: period and high time in samples, trigger: start and length
+	double period = 0.0, high = 0.0, delay = 0.0;
+	float volts = 0.f;
+	float value(int64_t frame){
+		if(period > 0.0)
+			return frame >= delay && std::fmod(frame - delay, period) < high ? 10.f : 0.f;
+		if(high > 0.0)
+			return frame >= delay && frame < delay + high ? 10.f : 0.f;
+		return volts;
+	}
+};
+
+struct Recording {
+	PatchModule* pm;
+	int outputId;
+	std::string name;
+	//columns written, set after the first sample
+	int channels;
+};
+
+static void fail(int line, const std::string& message){
+	std::fprintf(stderr, "line %d: %s\n", line, message.c_str());
+	std::exit(2);
+}
+
+//"prefix<n>" with n from 1 to max, returns n - 1 or -1
+static int indexOf(const std::string& name, const std::string& prefix, int max){
+	if(name.compare(0, prefix.size(), prefix) != 0 || name.size() == prefix.size())
+		return -1;
+	std::string digits = name.substr(prefix.size());
+	if(digits.find_first_not_of("0123456789") != std::string::npos)
+		return -1;
+	int n = std::atoi(digits.c_str());
+	return n >= 1 && n <= max ? n - 1 : -1;
+}
+
+//"nN.inK" or "nN.outK" on a network
+static int nodePort(PatchModule& pm, const std::string& name, bool output){
+	size_t dot = name.find('.');
+	if(dot == std::string::npos) return -1;
+	int node = indexOf(name.substr(0, dot), "n", pm.ids.nodes);
+	int port = output ? indexOf(name.substr(dot + 1), "out", 4) : indexOf(name.substr(dot + 1), "in", 2);
+	if(node < 0 || port < 0) return -1;
+	return output ? pm.ids.trigOutput(node, port) : pm.ids.trigInput(node, port);
+}
+
+static int findInput(PatchModule& pm, const std::string& name){
+	int i;
+	if(pm.type == "network"){
+		if((i = nodePort(pm, name, false)) >= 0) return i;
+		if((i = indexOf(name, "reset", 6)) >= 0) return pm.ids.resetInput(i);
+		if(name == "attenuversion") return pm.ids.attenuversionInput();
+		if(name == "scene") return pm.ids.sceneInput();
+		if(name == "scenetrig") return pm.ids.sceneTrigInput();
+	}
+	else if(pm.type == "nexus"){
+		if((i = indexOf(name, "trig", nexus::NUM_STAGES)) >= 0) return nexus::trigInput(i);
+		if((i = indexOf(name, "reset", 2)) >= 0) return nexus::resetInput(i);
+		if(name == "seek") return nexus::SEEK_INPUT;
+	}
+	else{
+		if(name == "cv") return quantizer::CV_INPUT;
+		if(name == "root") return quantizer::ROOT_INPUT;
+		if(name == "mode") return quantizer::MODE_INPUT;
+	}
+	return -1;
+}
+
+static int findOutput(PatchModule& pm, const std::string& name){
+	int i;
+	if(pm.type == "network"){
+		if((i = nodePort(pm, name, true)) >= 0) return i;
+		if(name == "cv") return pm.ids.cvOutput();
+		if(name == "gate") return pm.ids.gateOutput();
+		if(name == "retrig") return pm.ids.retrigOutput();
+	}
+	else if(pm.type == "nexus"){
+		if((i = indexOf(name, "out", nexus::NUM_STAGES)) >= 0) return nexus::trigOutput(i);
+		if((i = indexOf(name, "next", nexus::NUM_STAGES)) >= 0) return nexus::nextOutput(i);
+		if(name == "step") return nexus::STEP_OUTPUT;
+	}
+	else{
+		if(name == "cv") return quantizer::CV_OUTPUT;
+		if(name == "trig") return quantizer::TRIG_OUTPUT;
+	}
+	return -1;
+}
+
+static int findParam(PatchModule& pm, const std::string& name){
+	int i;
+	if(pm.type == "network"){
+		if((i = indexOf(name, "node", pm.ids.nodes)) >= 0) return pm.ids.valParam(i);
+		if((i = indexOf(name, "bypass", pm.ids.bypasses)) >= 0) return pm.ids.bypassParam(i);
+		if(name == "attenuversion") return pm.ids.attenuversionParam();
+		if(name == "bipolar") return pm.ids.bipolarParam();
+	}
+	else if(pm.type == "nexus"){
+		if((i = indexOf(name, "reps", nexus::NUM_STAGES)) >= 0) return nexus::repsParam(i);
+	}
+	else{
+		if(name == "root") return quantizer::ROOT_PARAM;
+		if(name == "mode") return quantizer::MODE_PARAM;
+	}
+	return -1;
+}
+
+static void writeWavHeader(FILE* file, int channels, int rate, uint32_t dataSize){
+	auto u32 = [&](uint32_t v){ std::fwrite(&v, 4, 1, file); };
+	auto u16 = [&](uint16_t v){ std::fwrite(&v, 2, 1, file); };
+	std::fwrite("RIFF", 1, 4, file); u32(36 + dataSize);
+	std::fwrite("WAVEfmt ", 1, 8, file); u32(16);
+	//ieee float
+	u16(3); u16(channels); u32(rate); u32(rate * channels * 4); u16(channels * 4); u16(32);
+	std::fwrite("data", 1, 4, file); u32(dataSize);
+}
+
+int main(int argc, char** argv){
+	std::string patchPath, outPath;
+	bool everySample = false;
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		if(arg == "-o" && i + 1 < argc) outPath = argv[++i];
+		else if(arg == "--every-sample") everySample = true;
+		else if(arg[0] != '-' && patchPath.empty()) patchPath = arg;
+		else{
+			patchPath.clear();
+			break;
+		}
+	}
+	if(patchPath.empty() || outPath.empty()){
+		std::fprintf(stderr, "usage: %s PATCH -o out.csv|out.wav [--every-sample]\n", argv[0]);
+		return 2;
+	}
+	std::ifstream patch(patchPath);
+	if(!patch){
+		std::fprintf(stderr, "can't read %s\n", patchPath.c_str());
+		return 2;
+	}
+
+	float rate = 4000.f;
+	float seconds = 60.f;
+	std::vector<std::string> lines;
+	for(std::string line; std::getline(patch, line);)
+		lines.push_back(line.substr(0, line.find('#')));
+	//the rate has to be known before any module is made
+	for(const std::string& line : lines){
+		std::stringstream ss(line);
+		std::string word;
+		ss >> word;
+		if(word == "rate") ss >> rate;
+	}
+
+	Host host(rate);
+	std::vector<PatchModule> modules;
+	modules.reserve(lines.size());
+	std::vector<Source> sources;
+	std::vector<Recording> recordings;
+
+	for(size_t n = 0; n < lines.size(); n++){
+		int line = n + 1;
+		std::stringstream ss(lines[n]);
+		std::string word;
+		if(!(ss >> word) || word == "rate") continue;
+
+		auto getModule = [&]() -> PatchModule& {
+			size_t m = 0;
+			if(!(ss >> m) || m < 1 || m > modules.size()) fail(line, "no such module");
+			return modules[m - 1];
+		};
+		auto getName = [&]() -> std::string {
+			std::string name;
+			if(!(ss >> name)) fail(line, "missing port or param name");
+			return name;
+		};
+		size_t brace = lines[n].find('{');
+		const char* json = brace == std::string::npos ? nullptr : lines[n].c_str() + brace;
+
+		if(word == "seconds") ss >> seconds;
+		else if(word == "network"){
+			std::string size = "4x4";
+			ss >> size;
+			PatchModule pm;
+			pm.type = word;
+			if(size == "4x2") pm.ids = NetworkIds(4, 2), pm.module = host.add("Network4x2", json);
+			else if(size == "4x8") pm.ids = NetworkIds(4, 8), pm.module = host.add("Network4x8", json);
+			else pm.module = host.add("Network", json);
+			modules.push_back(pm);
+		}
+		else if(word == "nexus" || word == "quantizer"){
+			PatchModule pm;
+			pm.type = word;
+			pm.module = host.add(word == "nexus" ? "Nexus" : "Quantizer", json);
+			modules.push_back(pm);
+		}
+		else if(word == "knob"){
+			PatchModule& pm = getModule();
+			std::string name = getName();
+			int id = findParam(pm, name);
+			float value;
+			if(id < 0 || !(ss >> value)) fail(line, "bad knob " + name);
+			pm.module->params[id].setValue(value);
+		}
+		else if(word == "cable"){
+			PatchModule& from = getModule();
+			std::string out = getName();
+			PatchModule& to = getModule();
+			std::string in = getName();
+			int outputId = findOutput(from, out);
+			int inputId = findInput(to, in);
+			if(outputId < 0) fail(line, "no output " + out);
+			if(inputId < 0) fail(line, "no input " + in);
+			host.connect(from.module, outputId, to.module, inputId);
+		}
+		else if(word == "clock" || word == "trigger" || word == "voltage"){
+			Source s;
+			s.pm = &getModule();
+			std::string in = getName();
+			s.inputId = findInput(*s.pm, in);
+			if(s.inputId < 0) fail(line, "no input " + in);
+			if(word == "trigger"){
+				float time = 0.f;
+				ss >> time;
+				s.delay = time * rate;
+				s.high = 1e-3 * rate;
+			}
+			else if(word == "voltage")
+				ss >> s.volts;
+			else{
+				double hz = 0.0, ppq = 1.0, width = 0.5, delay = 0.0;
+				for(std::string key; ss >> key;){
+					double value = 0.0;
+					if(!(ss >> value)) fail(line, "missing value for " + key);
+					if(key == "bpm") hz = value / 60.0;
+					else if(key == "hz") hz = value;
+					else if(key == "ppq") ppq = value;
+					else if(key == "width") width = value;
+					else if(key == "delay") delay = value;
+					else if(key == "channels") s.channels = clamp((int) value, 1, 16);
+					else fail(line, "unknown clock setting " + key);
+				}
+				if(hz <= 0.0) fail(line, "clock needs bpm or hz");
+				s.period = rate / (hz * ppq);
+				s.high = s.period * clamp((float) width, 0.f, 1.f);
+				s.delay = delay * rate;
+			}
+			sources.push_back(s);
+		}
+		else if(word == "record"){
+			PatchModule& pm = getModule();
+			std::string out = getName();
+			int id = findOutput(pm, out);
+			if(id < 0) fail(line, "no output " + out);
+			recordings.push_back({&pm, id, string::f("%d %s", (int) (&pm - &modules[0]) + 1, out.c_str()), 1});
+		}
+		else fail(line, "unknown statement " + word);
+	}
+
+	if(recordings.empty()){
+		for(size_t m = 0; m < modules.size(); m++){
+			PatchModule& pm = modules[m];
+			std::vector<std::string> names;
+			if(pm.type == "network") names = {"cv", "gate", "retrig"};
+			else if(pm.type == "nexus") names = {"out1", "out2", "out3", "out4", "out5", "out6", "step"};
+			else names = {"cv", "trig"};
+			for(const std::string& name : names)
+				recordings.push_back({&pm, findOutput(pm, name), string::f("%d %s", (int) m + 1, name.c_str()), 1});
+		}
+	}
+	//recorded outputs are patched, like a cable to the recorder
+	for(Recording& r : recordings)
+		host.plug(r.pm->module, r.outputId);
+
+	//sources driving the same input are mixed by taking the highest voltage
+	std::map<std::pair<Module*, int>, std::vector<Source*>> driven;
+	for(Source& s : sources)
+		driven[{s.pm->module, s.inputId}].push_back(&s);
+
+	bool wav = outPath.size() > 4 && outPath.compare(outPath.size() - 4, 4, ".wav") == 0;
+	FILE* file = std::fopen(outPath.c_str(), wav ? "wb" : "w");
+	if(!file){
+		std::fprintf(stderr, "can't write %s\n", outPath.c_str());
+		return 2;
+	}
+
+	int64_t frames = (int64_t) (seconds * rate);
+	std::vector<float> row, previous;
+	bool channelsChanged = false;
+	auto start = std::chrono::steady_clock::now();
+
+	for(int64_t f = 0; f < frames; f++){
+		for(auto& d : driven){
+			float voltages[16] = {};
+			int channels = 1;
+			for(Source* s : d.second){
+				float v = s->value(f);
+				channels = std::max(channels, s->channels);
+				for(int c = 0; c < s->channels; c++)
+					voltages[c] = std::max(voltages[c], v);
+			}
+			Host::drive(d.first.first, d.first.second, voltages, channels);
+		}
+		host.step();
+
+		if(f == 0){
+			int columns = 0;
+			for(Recording& r : recordings){
+				r.channels = std::max(r.pm->module->outputs[r.outputId].getChannels(), 1);
+				columns += r.channels;
+			}
+			row.resize(columns);
+			if(wav)
+				writeWavHeader(file, columns, (int) rate, 0);
+			else{
+				std::fprintf(file, "sample,time");
+				for(Recording& r : recordings)
+					for(int c = 0; c < r.channels; c++)
+						std::fprintf(file, ",%s %d", r.name.c_str(), c + 1);
+				std::fprintf(file, "\n");
+			}
+		}
+
+		size_t i = 0;
+		for(Recording& r : recordings){
+			Output& out = r.pm->module->outputs[r.outputId];
+			if(out.getChannels() != r.channels) channelsChanged = true;
+			for(int c = 0; c < r.channels; c++)
+				row[i++] = c < out.getChannels() ? out.getVoltage(c) : 0.f;
+		}
+
+		if(wav)
+			std::fwrite(row.data(), sizeof(float), row.size(), file);
+		else if(everySample || row != previous){
+			std::fprintf(file, "%lld,%.6f", (long long) f, f / rate);
+			for(float v : row)
+				std::fprintf(file, ",%g", v);
+			std::fprintf(file, "\n");
+			previous = row;
+		}
+	}
+
+	if(wav){
+		uint64_t dataSize = (uint64_t) frames * row.size() * sizeof(float);
+		if(dataSize > 0xFFFFFFF0ULL)
+			std::fprintf(stderr, "wav is over 4GB, its header is wrong\n");
+		std::fseek(file, 0, SEEK_SET);
+		writeWavHeader(file, row.size(), (int) rate, (uint32_t) dataSize);
+	}
+	std::fclose(file);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::fprintf(stderr, "rendered %.1fs at %g Hz in %.0fms\n", seconds, rate, ms);
+	if(channelsChanged)
+		std::fprintf(stderr, "an output's channel count changed after the first sample, only its first channels were written\n");
+	return 0;
+}
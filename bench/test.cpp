@@ -0,0 +1,259 @@
+// Behaviour checks on the modules' engine code, run with make test
+#include "host.hpp"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)){ failures++; std::printf("FAIL %s:%d: ", __FILE__, __LINE__); std::printf(__VA_ARGS__); std::printf("\n"); } } while(0)
+
+//a node's trigger raises its voice's gate, and the voice's cv and retrig go out on the same sample
+static void testSameSampleVoice(int channels){
+	Host host(44100.f);
+	NetworkIds ids(4, 4);
+	Module* m = host.add("Network", string::f("{\"channels\": %d, \"polyMode\": 0}", channels).c_str());
+	m->params[ids.attenuversionParam()].setValue(1.f);
+	m->params[ids.bipolarParam()].setValue(1.f);
+	m->params[ids.valParam(0)].setValue(0.8f);
+	m->params[ids.valParam(1)].setValue(0.2f);
+	host.plug(m, ids.cvOutput());
+	host.plug(m, ids.gateOutput());
+	host.plug(m, ids.retrigOutput());
+	Output& cv = m->outputs[ids.cvOutput()];
+	Output& gate = m->outputs[ids.gateOutput()];
+	Output& retrig = m->outputs[ids.retrigOutput()];
+
+	//node 1 plays first and ends, so node 0's voice is a new value on the cv output.
+	//nodes ignore trigs for their first 1ms
+	float low = 0.f, high = 10.f;
+	for(int f = 0; f < 400; f++){
+		Host::drive(m, ids.trigInput(1, 0), f >= 100 && f < 200 ? &high : &low, 1);
+		Host::drive(m, ids.trigInput(0, 0), &low, 1);
+		host.step();
+	}
+	int last = channels - 1;
+	int ch = channels > 1 ? 1 : 0;
+	CHECK(gate.getVoltage(0) == 0.f && cv.getVoltage(0) == -3.f, "%d channels: node 2 didn't play and end on channel 0", channels);
+	CHECK(gate.getVoltage(ch) == 0.f, "%d channels: gate %d high before the trigger", channels, ch);
+
+	Host::drive(m, ids.trigInput(0, 0), &high, 1);
+	host.step();
+	//rotate mode gives the new voice the next channel
+	CHECK(gate.getVoltage(ch) == 10.f, "%d channels: gate %d is %g on the trigger's sample", channels, ch, gate.getVoltage(ch));
+	CHECK(retrig.getVoltage(ch) == 10.f, "%d channels: retrig %d is %g on the trigger's sample", channels, ch, retrig.getVoltage(ch));
+	CHECK(std::fabs(cv.getVoltage(ch) - 3.f) < 1e-4f, "%d channels: cv %d is %g on the trigger's sample, not 3V", channels, ch, cv.getVoltage(ch));
+	CHECK(last == ch || gate.getVoltage(last) == 0.f, "%d channels: gate %d went high too", channels, last);
+}
+
+//node states set after a reset, e.g. by a preset, aren't thrown away by the next trigger
+static void testStateAfterReset(){
+	Host host(44100.f);
+	NetworkIds ids(4, 4);
+	Module* m = host.add("Network");
+	for(int out = 0; out < 4; out++)
+		host.plug(m, ids.trigOutput(0, out));
+
+	float low = 0.f, high = 10.f;
+	for(int f = 0; f < 100; f++){
+		Host::drive(m, ids.resetInput(0), f >= 50 ? &high : &low, 1);
+		host.step();
+	}
+
+	json_t* rootJ = json_object();
+	json_t* statesJ = json_array();
+	for(int node = 0; node < ids.nodes; node++)
+		json_array_append_new(statesJ, json_integer(node == 0 ? 1 : -2));
+	json_object_set_new(rootJ, "nodeStates", statesJ);
+	m->dataFromJson(rootJ);
+	json_decref(rootJ);
+	host.step();
+
+	Host::drive(m, ids.trigInput(0, 0), &high, 1);
+	host.step();
+	CHECK(m->outputs[ids.trigOutput(0, 2)].getVoltage() == 10.f, "node 1 didn't go on from its restored state to output 3");
+}
+
+//a link into the next module goes low when that module stops being the neighbour, rather than sticking high
+static void testLinkToRemovedNeighbour(){
+	Host host(44100.f);
+	NetworkIds ids(4, 4);
+	//both node 0s go to output 1 on their next trigger, the left one's links to the right one's
+	auto preset = [&](bool linked){
+		json_t* rootJ = json_object();
+		json_t* statesJ = json_array();
+		json_t* linksJ = json_array();
+		json_t* hopsJ = json_array();
+		for(int node = 0; node < ids.nodes; node++){
+			json_array_append_new(statesJ, json_integer(node == 0 ? -1 : -2));
+			json_t* nodeLinksJ = json_array();
+			json_t* nodeHopsJ = json_array();
+			for(int out = 0; out < 4; out++){
+				json_array_append_new(nodeLinksJ, json_integer(linked && node == 0 ? 0 : -1));
+				json_array_append_new(nodeHopsJ, json_integer(linked && node == 0 ? 1 : 0));
+			}
+			json_array_append_new(linksJ, nodeLinksJ);
+			json_array_append_new(hopsJ, nodeHopsJ);
+		}
+		json_object_set_new(rootJ, "nodeStates", statesJ);
+		json_object_set_new(rootJ, "links", linksJ);
+		json_object_set_new(rootJ, "linkHops", hopsJ);
+		return rootJ;
+	};
+	Module* left = host.add("Network");
+	Module* right = host.add("Network");
+	json_t* rootJ = preset(true);
+	left->dataFromJson(rootJ);
+	json_decref(rootJ);
+	rootJ = preset(false);
+	right->dataFromJson(rootJ);
+	json_decref(rootJ);
+	host.plug(right, ids.trigOutput(0, 0));
+	Output& out = right->outputs[ids.trigOutput(0, 0)];
+
+	float low = 0.f, high = 10.f;
+	for(int f = 0; f < 210; f++){
+		Host::drive(left, ids.trigInput(0, 0), f >= 200 ? &high : &low, 1);
+		host.step();
+	}
+	CHECK(out.getVoltage() == 10.f, "the link didn't reach the right module's node 1");
+
+	left->rightExpander.module = nullptr;
+	right->leftExpander.module = nullptr;
+	for(int f = 0; f < 10; f++)
+		host.step();
+	CHECK(out.getVoltage() == 0.f, "the link stayed high after its module was moved away");
+}
+
+//a clock sent on the same sample as a reset is ignored, whether the channels are independent or not
+static void testNexusClockWithReset(bool independent, float width){
+	Host host(44100.f);
+	Module* m = host.add("Nexus", independent ? "{\"independentChannels\": true}" : "{\"independentChannels\": false}");
+	host.plug(m, nexus::STEP_OUTPUT);
+	Output& step = m->outputs[nexus::STEP_OUTPUT];
+	const char* mode = independent ? "independent" : "shared";
+	int period = 441;
+	int high = (int) (width * 44.1f);
+	for(int f = 0; f < period * 8; f++){
+		float clock = f % period < high ? 10.f : 0.f;
+		float reset = f >= period * 5 && f < period * 5 + 20 ? 10.f : 0.f;
+		Host::drive(m, nexus::trigInput(0), &clock, 1);
+		Host::drive(m, nexus::resetInput(0), &reset, 1);
+		host.step();
+		if(f == period * 5 + period / 2)
+			CHECK(step.getVoltage() == 0.f, "%s, %gms clocks: the clock with the reset counted, step is %g", mode, width, step.getVoltage());
+		if(f == period * 7 + period / 2)
+			CHECK(std::fabs(step.getVoltage() - 0.02f) < 1e-4f, "%s, %gms clocks: 2 clocks after the reset, step is %g", mode, width, step.getVoltage());
+	}
+}
+
+//plugging in a seek cable keeps the current step, only a change of the seek voltage moves Nexus
+static void testNexusSeekOnPlug(){
+	Host host(44100.f);
+	Module* m = host.add("Nexus");
+	host.plug(m, nexus::STEP_OUTPUT);
+	Output& step = m->outputs[nexus::STEP_OUTPUT];
+	float low = 0.f, high = 10.f;
+	for(int f = 0; f < 441 * 4; f++){
+		Host::drive(m, nexus::trigInput(0), f % 441 > 100 && f % 441 < 200 ? &high : &low, 1);
+		host.step();
+	}
+	CHECK(std::fabs(step.getVoltage() - 0.04f) < 1e-4f, "4 clocks gave step %g", step.getVoltage());
+
+	float seek = 0.f;
+	for(int f = 0; f < 10; f++){
+		Host::drive(m, nexus::SEEK_INPUT, &seek, 1);
+		host.step();
+	}
+	CHECK(std::fabs(step.getVoltage() - 0.04f) < 1e-4f, "plugging in seek at 0V moved to step %g", step.getVoltage());
+
+	seek = 0.02f;
+	Host::drive(m, nexus::SEEK_INPUT, &seek, 1);
+	host.step();
+	CHECK(std::fabs(step.getVoltage() - 0.02f) < 1e-4f, "seeking to 0.02V gave step %g", step.getVoltage());
+}
+
+//nodes of chained modules that fire on the same sample start their voices on the same sample
+static void testChainedVoicesAligned(){
+	Host host(44100.f);
+	NetworkIds ids(4, 4);
+	Module* left = host.add("Network", "{\"channels\": 4}");
+	Module* right = host.add("Network");
+	host.plug(left, ids.gateOutput());
+	Output& gate = left->outputs[ids.gateOutput()];
+	float low = 0.f, high = 10.f;
+	for(int f = 0; f < 200; f++){
+		for(Module* m : {left, right})
+			Host::drive(m, ids.trigInput(0, 0), f >= 100 ? &high : &low, 1);
+		host.step();
+		int gates = 0;
+		for(int ch = 0; ch < 4; ch++)
+			gates += gate.getVoltage(ch) > 0.f;
+		if(gates > 0){
+			CHECK(gates == 2, "%d voice started on the first sample, not 2", gates);
+			return;
+		}
+	}
+	CHECK(false, "no voice started");
+}
+
+//hysteresis holds a note just past the boundary with its neighbour, but doesn't bend where other inputs land
+static void testQuantizerHysteresis(){
+	Host host(44100.f);
+	Module* m = host.add("Quantizer", "{\"hysteresis\": 10.0}");
+	m->params[quantizer::MODE_PARAM].setValue(0.f);
+	host.plug(m, quantizer::CV_OUTPUT);
+	Output& out = m->outputs[quantizer::CV_OUTPUT];
+	auto play = [&](float semitones){
+		float v = semitones / 12.f;
+		Host::drive(m, quantizer::CV_INPUT, &v, 1);
+		host.step();
+		return out.getVoltage() * 12.f;
+	};
+
+	play(0.f);
+	float note = play(0.55f);
+	CHECK(std::fabs(note) < 1e-4f, "5 cents past the boundary moved C to %g", note);
+	note = play(0.65f);
+	CHECK(std::fabs(note - 1.f) < 1e-4f, "15 cents past the boundary left the note at %g", note);
+	note = play(0.45f);
+	CHECK(std::fabs(note - 1.f) < 1e-4f, "5 cents back over the boundary moved C# to %g", note);
+
+	play(0.f);
+	note = play(3.55f);
+	CHECK(std::fabs(note - 4.f) < 1e-4f, "a jump from C to 5 cents past the D#/E boundary gave %g", note);
+}
+
+//the note a channel starts on isn't a change, on the first sample or when channels are added
+static void testQuantizerNoTrigOnStart(){
+	Host host(44100.f);
+	Module* m = host.add("Quantizer");
+	host.plug(m, quantizer::TRIG_OUTPUT);
+	Output& trig = m->outputs[quantizer::TRIG_OUTPUT];
+	float cv[2] = {0.3f, 0.55f};
+	Host::drive(m, quantizer::CV_INPUT, cv, 1);
+	host.step();
+	CHECK(trig.getVoltage(0) == 0.f, "trig on the first sample");
+	Host::drive(m, quantizer::CV_INPUT, cv, 2);
+	host.step();
+	CHECK(trig.getVoltage(1) == 0.f, "trig on an added channel");
+	cv[1] = 0.8f;
+	Host::drive(m, quantizer::CV_INPUT, cv, 2);
+	host.step();
+	CHECK(trig.getVoltage(1) == 10.f, "no trig when the added channel's note changed");
+}
+
+int main(){
+	testSameSampleVoice(1);
+	testSameSampleVoice(4);
+	testStateAfterReset();
+	testLinkToRemovedNeighbour();
+	for(bool independent : {false, true}){
+		testNexusClockWithReset(independent, 0.5f);
+		testNexusClockWithReset(independent, 5.f);
+	}
+	testNexusSeekOnPlug();
+	testChainedVoicesAligned();
+	testQuantizerHysteresis();
+	testQuantizerNoTrigOnStart();
+	if(failures == 0)
+		std::printf("all tests passed\n");
+	return failures ? 1 : 0;
+}
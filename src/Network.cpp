@@ -1,5 +1,8 @@
 #include "plugin.hpp"
 #include <math.h>
+#include <osdialog.h>
+#include <map>
+#include <thread>
 
 #define PI 3.14159265
 
@@ -15,10 +18,141 @@ enum PolyMode {
     NUM_POLY_MODES
 };
 
+//which channel to take when rotate/reset mode runs out of free ones
+enum StealMode {
+	STEAL_DEFAULT,
+	STEAL_OLDEST,
+	STEAL_NEWEST,
+	STEAL_LOWEST_NODE,
+	STEAL_ROUND_ROBIN,
+	NUM_STEAL_MODES
+};
+
+//how a channel's cv glides to a new voice
+enum GlideCurve {
+	GLIDE_LINEAR,
+	GLIDE_EXPONENTIAL,
+	NUM_GLIDE_CURVES
+};
+
 const int NODE_NUM_INS = 2;
 const int NODE_NUM_OUTS = 4;
+//most nodes one voice allocator can handle, across a chain of modules
+const int MAX_NODES = 64;
+//voices beyond the first 16 channel bus go out of the chained modules, one bus each
+const int BUS_CHANNELS = 16;
+const int MAX_BUSES = 4;
+const int MAX_CHANNELS = BUS_CHANNELS * MAX_BUSES;
+
+//gate change travelling along an internal node-to-node link
+struct LinkEvent{
+	int target;
+	bool high;
+	//modules to travel along the chain, negative is leftwards
+	int hops;
+};
+
+const int LINK_QUEUE_SIZE = 256;
+typedef dsp::RingBuffer<LinkEvent, LINK_QUEUE_SIZE> LinkQueue;
 
-struct OutputRouter;
+//a node starting or ending its voice. node is local to the module
+//until it is sent along the chain, then it's the chain wide id
+struct VoiceEvent{
+	int node;
+	bool play;
+};
+
+const int VOICE_QUEUE_SIZE = 256;
+typedef dsp::RingBuffer<VoiceEvent, VOICE_QUEUE_SIZE> VoiceQueue;
+
+//most modules in a chain, all 4x2s
+const int MAX_CHAIN_MODULES = MAX_NODES / 8;
+
+//expander message between neighbouring Networks, double buffered by the engine.
+//voices are allocated by the leftmost module of a chain
+struct NetworkMessage{
+	//rightwards: chain wide id the receiver's first node starts at
+	int nodeOffset;
+	//rightwards: modules in the chain, and the receiver's place in it, 0 is the first
+	int chainModules;
+	int chainPosition;
+	//rightwards: nodes currently lit by the chain's voice allocator
+	uint64_t litNodes;
+	//leftwards: sender is sharing the receiver's voice allocator
+	bool chained;
+	//leftwards: one past the last node id in the chain
+	int chainEnd;
+	//leftwards: chained modules from the sender to the end of the chain
+	int chainDepth;
+	//node count of the sender, for the links menu
+	int numNodes;
+	//rightwards: the chain's voices, the receiver outputs bus number busIndex
+	int busIndex;
+	int numChannels;
+	float cv[MAX_CHANNELS];
+	float gate[MAX_CHANNELS];
+	float retrig[MAX_CHANNELS];
+	//leftwards: knob values of the chain's nodes, by chain wide id
+	float knobs[MAX_NODES];
+	VoiceEvent voices[VOICE_QUEUE_SIZE];
+	int numVoices;
+	//links held high from the sender's side of the chain, hops counted from the receiver.
+	//levels rather than changes, so a lost message or a removed neighbour can't leave one high
+	LinkEvent links[LINK_QUEUE_SIZE];
+	int numLinks;
+};
+
+//changes from the ui or a preset, applied by the engine at the start of a sample
+enum CommandType {
+	SET_CHANNELS_COMMAND,
+	SET_POLY_MODE_COMMAND,
+	SET_STEAL_MODE_COMMAND,
+	SET_NODE_STATE_COMMAND,
+	SET_LINK_COMMAND,
+	SET_LINK_HOPS_COMMAND,
+	SAVE_SCENE_COMMAND,
+	LOAD_SCENE_COMMAND,
+	SET_QUANTIZE_ROOT_COMMAND,
+	SET_QUANTIZE_MODE_COMMAND,
+	SET_GLIDE_TIME_COMMAND,
+	SET_GLIDE_CURVE_COMMAND,
+	SEEK_ALLOCATION_COMMAND,
+	SEEK_VOICE_COMMAND
+};
+
+struct Command{
+	CommandType type;
+	int value;
+	int node;
+	int out;
+};
+
+//a preset queues up to 7 commands, plus a state and NODE_NUM_OUTS links and link hops per node.
+//295 for a 4x8, so there's room for one preset and changes from the menus while the engine catches up
+const int COMMAND_QUEUE_SIZE = 512;
+
+const int NUM_SCENES = 64;
+
+//hand-off of scenes loaded from a preset to the engine
+enum SceneStagingState {
+	STAGING_IDLE,
+	STAGING_PENDING,
+	STAGING_COPYING
+};
+
+//offline rendering runs at a low rate: 1ms is 4 samples, one step is 8ms
+const float RENDER_SAMPLE_RATE = 4000.f;
+const int RENDER_STEP_SAMPLES = 32;
+//sequence analysis gives up on loops longer than this
+const int MAX_SEQUENCE_STEPS = 4096;
+//steps listed in the jump to step menu
+const int MAX_SEEK_MENU_STEPS = 64;
+
+//a cable from one of Network's outputs back into one of its own inputs
+struct RenderCable{
+	int outputId;
+	int inputId;
+};
 
 struct Node{
     Param* knob;
@@ -30,22 +164,41 @@ struct Node{
     int id;
     int state = -2;
     bool bypass = false;
-   	dsp::SchmittTrigger inputTriggers[NODE_NUM_INS][16];
+   	TriggerBank inputTriggers[NODE_NUM_INS];
+	//one bit per input channel, set while that channel's gate is high
+	uint32_t highMask = 0;
 	dsp::Timer suppressTrigsTimer;
+
+	//internal links: target node for each output, -1 for none
+	int links[NODE_NUM_OUTS];
+	//module along the chain each link's target is in, 0 for this one
+	int linkHops[NODE_NUM_OUTS];
+	//number of incoming links currently high, from this module's nodes and from neighbouring modules
+	int linksHigh = 0;
+	int remoteLinksHigh = 0;
+	//output whose link is currently held high by this node
+	int activeLink = -1;
+	int activeTarget = -1;
+	int activeHops = 0;
+	LinkQueue* linkQueue;
     
-    OutputRouter* outputRouter;
+    VoiceQueue* voiceQueue;
 	float lightBrightness = 0.f;
 	bool doReset = false;
     
-    void init(int _id, Param* _knob, Light* _light, Input* _input, Output* _output, OutputRouter* _out, Param* _bypassBtn = nullptr){
+    void init(int _id, Param* _knob, Light* _light, Input* _input, Output* _output, VoiceQueue* _voiceQueue, LinkQueue* _linkQueue, Param* _bypassBtn = nullptr){
         id = _id;
         knob = _knob;
         light = _light;
         input1 = _input;
         output1 = _output;
-        outputRouter = _out;
+        voiceQueue = _voiceQueue;
+		linkQueue = _linkQueue;
 		bypassBtn = _bypassBtn;
-
+		for(int i = 0; i < NODE_NUM_OUTS; i++){
+			links[i] = -1;
+			linkHops[i] = 0;
+		}
     }
 
     Input * getInput(int n){
@@ -61,11 +214,11 @@ struct Node{
 	}
 
 	bool allTrigsLow(){
-		for (int in = 0; in < NODE_NUM_INS; in++)
-			for (int ch = 0; ch < 16; ch++)
-				if(inputTriggers[in][ch].isHigh()) 
-					return false;
-		return true;
+		return highMask == 0 && linksHigh == 0 && remoteLinksHigh == 0;
+	}
+
+	bool isOutputUsed(int n){
+		return links[n] >= 0 || getOutput(n)->isConnected();
 	}
 
     void process(float dt){
@@ -73,21 +226,68 @@ struct Node{
 		light->setSmoothBrightness(lightBrightness, dt);
 
 		bool doTrigger = false;   
+		highMask = 0;
 		for (int in = 0; in < NODE_NUM_INS; in++){
-			for (int ch = 0; ch < 16; ch++){							
-				float val = getInput(in)->getVoltage(ch);
-				val = rescale(val, 0.1f, 2.f, 0.f, 1.f);//obey voltage stadards for triggers
-				if(inputTriggers[in][ch].process(val)) doTrigger = true;
-			}
+			if(inputTriggers[in].process(getInput(in))) doTrigger = true;
+			highMask |= (uint32_t) inputTriggers[in].highMask << (in * 16);
         }
 		if(suppressTrigsTimer.process(dt) > 1e-3f && doTrigger) trigger();  
         		
+		updateGate();
+    }
+
+	//gate arriving over an internal link from another node's output.
+	//links only send changes, so every high is a rising edge
+	void processLink(bool high){
+		if(high) linksHigh++;
+		else if(linksHigh > 0) linksHigh--;
+
+		if(high && suppressTrigsTimer.time > 1e-3f) trigger();
+
+		updateGate();
+	}
+
+	//set the incoming link counts outright, when they're known from levels rather than changes.
+	//a rise triggers like a link event would
+	void setLinksHigh(int local, int remote){
+		if(local == linksHigh && remote == remoteLinksHigh)
+			return;
+		bool rising = local > linksHigh || remote > remoteLinksHigh;
+		linksHigh = local;
+		remoteLinksHigh = remote;
+
+		if(rising && suppressTrigsTimer.time > 1e-3f) trigger();
+
+		updateGate();
+	}
+
+	void updateGate(){
+		bool gate = not allTrigsLow();
+
 		if (state >= 0)
-			getOutput(state)->setVoltage(allTrigsLow() ? 0.f : 10.f);
-		else if(state == -1 && allTrigsLow())
+			getOutput(state)->setVoltage(gate ? 10.f : 0.f);
+		else if(state == -1 && not gate)
 			stop();	
 
-    }
+		//forward gate changes to linked nodes. links to other modules are sent as levels, see NetworkMessage
+		int link = -1;
+		int target = -1;
+		int hops = 0;
+		if(state >= 0 && gate && links[state] >= 0){
+			link = state;
+			target = links[state];
+			hops = linkHops[state];
+		}
+		if(link != activeLink || target != activeTarget || hops != activeHops){
+			if(activeTarget >= 0 && activeHops == 0 && not linkQueue->full())
+				linkQueue->push({activeTarget, false, 0});
+			if(target >= 0 && hops == 0 && not linkQueue->full())
+				linkQueue->push({target, true, 0});
+			activeLink = link;
+			activeTarget = target;
+			activeHops = hops;
+		}
+	}
   
     void trigger(){
 		//ignore trigs that are too close together
@@ -112,7 +312,7 @@ struct Node{
                     return;
                 }
             }
-            else if(getOutput(state)->isConnected()){
+            else if(isOutputUsed(state)){
         		return; 
             }
         }
@@ -120,14 +320,29 @@ struct Node{
 		reset();
     }
 
+	//jump to a state, cleanly ending whatever this node was outputting.
+	//overrides a pending reset, or the next trigger would throw the state away
+	void setState(int s){
+		if(state >= 0)
+			getOutput(state)->setVoltage(0.f);
+		else if(state == -1)
+			stop();
+		state = s;
+		doReset = false;
+	}
+
     void advanceState(){
         state++;
         if(state >= NODE_NUM_OUTS) state = -1;
     }
 
-	void play();
+	void play(){
+		if(not voiceQueue->full()) voiceQueue->push({id, true});
+	}
 
-	void stop();
+	void stop(){
+		if(not voiceQueue->full()) voiceQueue->push({id, false});
+	}
 
     void reset(){
         doReset = true;
@@ -135,309 +350,1406 @@ struct Node{
 
 };
 
+//allocates channels to nodes by id, the nodes may be spread across a chain of modules.
+//channels past the first bus are only kept in the value arrays, for the chain to output
 struct OutputRouter{
     int numChannels = 16;
-    Node* channels[16];
+	//node playing on each channel or -1
+    int channels[MAX_CHANNELS];
+	//reverse index, channel each node is playing on or -1
+	int nodeChannels[MAX_NODES];
+	//one bit per channel / node id currently playing
+	uint64_t usedChannels = 0;
+	uint64_t usedNodes = 0;
+	//nodes playing on a channel below numChannels, for the node lights
+	uint64_t litNodes = 0;
+	//channels in order of allocation, for oldest/newest stealing
+	int olderChannel[MAX_CHANNELS];
+	int newerChannel[MAX_CHANNELS];
+	int oldestChannel = -1;
+	int newestChannel = -1;
     
     PolyMode polyMode = RESET_MODE;
+	StealMode stealMode = STEAL_DEFAULT;
     int rotateIndex = -1;
+	int stealIndex = -1;
 
     Output* cvOut;
     Output* gateOut;
 	Output* retrigOut;
+	//knob value of every node, by id
+	const float* nodeKnobs;
 
 	float cvMin = 0;
 	float cvMax = 10;
 
-	dsp::PulseGenerator retrigPulses[16];
+	//snaps cv to a scale, as 1V/oct. mode -1 is off
+	int quantizeRoot = 0;
+	int quantizeMode = -1;
+	ScaleTable scaleTable;
+
+	//glide time in ms, 0 is off. linear glides take the same time however far they go
+	int glideTime = 0;
+	GlideCurve glideCurve = GLIDE_LINEAR;
+	//where each channel's cv is gliding to, and how fast for linear glides
+	alignas(16) float cvTargets[MAX_CHANNELS] = {};
+	alignas(16) float glideRates[MAX_CHANNELS] = {};
+	uint64_t glidingChannels = 0;
+
+	//cv output is only recalculated for channels marked dirty
+	alignas(16) float cvValues[MAX_CHANNELS] = {};
+	float knobValues[MAX_CHANNELS] = {};
+	uint64_t dirtyChannels = 0;
+	float gateValues[MAX_CHANNELS] = {};
+	float retrigValues[MAX_CHANNELS] = {};
 
+	dsp::PulseGenerator retrigPulses[MAX_CHANNELS];
+	uint64_t activeRetrigs = 0;
 
-    void init(Output* cv, Output* gate, Output* retrig){
+
+    void init(Output* cv, Output* gate, Output* retrig, const float* knobs){
         cvOut = cv;
         gateOut = gate;
 		retrigOut = retrig;
-        for(int i = 0; i < 16; i++) channels[i] = nullptr;
+		nodeKnobs = knobs;
+        for(int i = 0; i < MAX_CHANNELS; i++) channels[i] = -1;
+		for(int i = 0; i < MAX_NODES; i++) nodeChannels[i] = -1;
     }
 
+	static uint64_t channelBits(int n){
+		return n >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << n) - 1;
+	}
+
+	//channel count of the first bus, the one on this module's outputs
+	int getBusChannels(){
+		return std::min(numChannels, BUS_CHANNELS);
+	}
+
+	void setGate(int ch, float v){
+		gateValues[ch] = v;
+		if(ch < BUS_CHANNELS) gateOut->setVoltage(v, ch);
+	}
+
+	void setRetrig(int ch, float v){
+		retrigValues[ch] = v;
+		if(ch < BUS_CHANNELS) retrigOut->setVoltage(v, ch);
+	}
+
     void process(float dt, bool bipolar, float attenuversion){
-        cvOut->setChannels(numChannels);
-		gateOut->setChannels(numChannels);
-		retrigOut->setChannels(numChannels);
+		uint64_t channelMask = channelBits(numChannels);
+		int busChannels = getBusChannels();
+
+		//outputs fall back to mono when a cable is plugged in, so check every sample.
+		//unpatched outputs stay at 0 channels whatever is set, so they're left alone
+		bool rewrite = false;
+		for(Output* out : {cvOut, gateOut, retrigOut}){
+			if(out->isConnected() && out->getChannels() != busChannels){
+				out->setChannels(busChannels);
+				rewrite = true;
+			}
+		}
+		//setChannels zeroes the channels it drops, put back what they were holding
+		if(rewrite){
+			for(int c = 0; c < busChannels; c += 4){
+				cvOut->setVoltageSimd(simd::float_4::load(&cvValues[c]), c);
+				gateOut->setVoltageSimd(simd::float_4::load(&gateValues[c]), c);
+				retrigOut->setVoltageSimd(simd::float_4::load(&retrigValues[c]), c);
+			}
+		}
 
+		float newMin, newMax;
 		if(bipolar){
-			cvMin = -5*attenuversion;
-			cvMax = 5*attenuversion;
+			newMin = -5*attenuversion;
+			newMax = 5*attenuversion;
 		}
 		else{
-			cvMin = 0;
-			cvMax = 10*attenuversion;
+			newMin = 0;
+			newMax = 10*attenuversion;
 		}
-		
-		for(int ch = 0; ch < numChannels; ch++){
-			if(channels[ch] != nullptr){
-				Node* node = channels[ch];
-
-				float out = node->knob->getValue();
-				out = rescale(out, 0.f, 1.f, cvMin, cvMax);
-				cvOut->setVoltage(out, ch);
-				node->lightBrightness = 1.f;		
+		if(newMin != cvMin || newMax != cvMax){
+			cvMin = newMin;
+			cvMax = newMax;
+			dirtyChannels |= usedChannels;
+		}
+
+		for(uint64_t used = usedChannels & channelMask; used; used &= used - 1){
+			int ch = __builtin_ctzll(used);
+			float knob = nodeKnobs[channels[ch]];
+			if(knob != knobValues[ch]){
+				knobValues[ch] = knob;
+				dirtyChannels |= (uint64_t) 1 << ch;
+			}
+		}
+
+		dirtyChannels &= channelMask;
+		//idle channels hold their last voltage
+		for(int c = 0; c < numChannels && dirtyChannels; c += 4){
+			uint32_t lanes = (dirtyChannels >> c) & 0xF;
+			if(not lanes) continue;
+			simd::float_4 knob = simd::float_4::load(&knobValues[c]);
+			simd::float_4 out = cvMin + knob * (cvMax - cvMin);
+			if(quantizeMode >= 0)
+				out = scaleTable.process(out);
+			simd::float_4 target = simd::float_4::load(&cvTargets[c]);
+			out = simd::ifelse(laneMask(lanes), out, target);
+			out.store(&cvTargets[c]);
+			if(glideTime > 0){
+				//leave the output where it is, the channel glides from there.
+				//only a new target sets the rate, so a linear glide keeps its speed to the end
+				simd::float_4 cv = simd::float_4::load(&cvValues[c]);
+				uint32_t changed = simd::movemask(out != target) & lanes;
+				simd::float_4 rate = simd::abs(out - cv) * (1000.f / glideTime);
+				simd::ifelse(laneMask(changed), rate, simd::float_4::load(&glideRates[c])).store(&glideRates[c]);
+				glidingChannels |= (uint64_t) changed << c;
+				out = cv;
 			}
-			retrigOut->setVoltage(retrigPulses[ch].process(dt)*10.f,ch);
+			out.store(&cvValues[c]);
+			if(c < BUS_CHANNELS) cvOut->setVoltageSimd(out, c);
+			dirtyChannels &= ~((uint64_t) 0xF << c);
 		}
+		dirtyChannels = 0;
 
+		glidingChannels &= channelMask;
+		if(glidingChannels)
+			processGlides(dt);
+
+		for(uint64_t active = activeRetrigs & channelMask; active; active &= active - 1){
+			int ch = __builtin_ctzll(active);
+			bool high = retrigPulses[ch].process(dt);
+			setRetrig(ch, high ? 10.f : 0.f);
+			if(not high) activeRetrigs &= ~((uint64_t) 1 << ch);
+		}
     }
 
+	//moves every gliding channel on by a sample, 4 at a time. blocks with no channel gliding are skipped
+	void processGlides(float dt){
+		//exponential glides get within 1% of the target in the glide time
+		float coef = 1.f - std::exp(-dt * 4.6f * 1000.f / glideTime);
+		for(uint64_t gliding = glidingChannels; gliding;){
+			int c = __builtin_ctzll(gliding) & ~3;
+			gliding &= ~((uint64_t) 0xF << c);
+			uint32_t lanes = (glidingChannels >> c) & 0xF;
+
+			simd::float_4 target = simd::float_4::load(&cvTargets[c]);
+			simd::float_4 cv = simd::float_4::load(&cvValues[c]);
+			simd::float_4 delta = target - cv;
+			if(glideCurve == GLIDE_EXPONENTIAL){
+				delta *= coef;
+			}
+			else{
+				simd::float_4 step = simd::float_4::load(&glideRates[c]) * dt;
+				delta = simd::clamp(delta, -step, step);
+			}
+			cv = simd::ifelse(laneMask(lanes), cv + delta, cv);
+
+			simd::float_4 arrived = simd::abs(target - cv) < 1e-4f;
+			cv = simd::ifelse(arrived, target, cv);
+			glidingChannels &= ~((uint64_t) (simd::movemask(arrived) & lanes) << c);
+
+			cv.store(&cvValues[c]);
+			if(c < BUS_CHANNELS) cvOut->setVoltageSimd(cv, c);
+		}
+	}
+
+	void setGlide(int time, GlideCurve curve){
+		glideTime = time;
+		glideCurve = curve;
+		//with glide off, channels still gliding jump to their targets
+		if(time <= 0){
+			dirtyChannels |= glidingChannels;
+			glidingChannels = 0;
+		}
+	}
+
    	void setPolyMode(PolyMode mode){
 		polyMode = mode;
 		rotateIndex = -1;
+		stealIndex = -1;
+		//fixed mode can leave nodes playing above the channel count
+		for(int i = numChannels; i < MAX_CHANNELS; i++) closeChannel(i);
+	}
+	void setStealMode(StealMode mode){
+		stealMode = mode;
+		stealIndex = -1;
+	}
+	void setQuantize(int root, int mode){
+		quantizeRoot = root;
+		quantizeMode = mode;
+		if(mode >= 0)
+			scaleTable.build(getScaleNotes(root, mode));
+		dirtyChannels |= usedChannels;
 	}
 	void setChannels(int n){
 		numChannels = n;
-		for(int i = n; i < 16; i++) closeChannel(i);
+		for(int i = n; i < MAX_CHANNELS; i++) closeChannel(i);
 		if(polyMode == ROTATE_MODE && rotateIndex > numChannels -1) rotateIndex = -1;
+		if(stealIndex > numChannels -1) stealIndex = -1;
 	}
 
-    void playNode(Node* node){
+    void playNode(int node){
+		if(nodeChannels[node] >= 0) closeChannel(nodeChannels[node]);
         int c = getChannel(node);
 		closeChannel(c);
-        channels[c] = node;
-		gateOut->setVoltage(10.f, c);
+		openChannel(c, node);
+		setGate(c, 10.f);
 		retrigPulses[c].trigger();
+		activeRetrigs |= (uint64_t) 1 << c;
     }
 
-	void stopNode(Node* node){
-		for(int ch = 0; ch < 16; ch++)
-			if(channels[ch] == node) closeChannel(ch);
+	void stopNode(int node){
+		if(nodeChannels[node] >= 0) closeChannel(nodeChannels[node]);
+	}
+
+	//end the voices of every node from id first upwards
+	void stopNodesFrom(int first){
+		uint64_t stop = first >= 64 ? 0 : usedNodes >> first << first;
+		for(; stop; stop &= stop - 1)
+			closeChannel(nodeChannels[__builtin_ctzll(stop)]);
+	}
+
+	void applyVoice(const VoiceEvent& e){
+		if(e.play) playNode(e.node);
+		else stopNode(e.node);
 	}
 
-	int getChannel(Node* node) {	
+	uint64_t getFreeChannels(){
+		return ~usedChannels & channelBits(numChannels);
+	}
+
+	int getChannel(int node) {	
         if (numChannels == 1)
 			return 0;
 
+		uint64_t free = getFreeChannels();
+
 		switch (polyMode) {
 
 			case ROTATE_MODE: {
-				// Find next available channel
-				for (int i = 0; i < numChannels; i++) {
+				// Find next available channel, wrapping around
+				uint64_t ahead = free & ~channelBits(rotateIndex + 1);
+				if (ahead)
+					rotateIndex = __builtin_ctzll(ahead);
+				else if (free)
+					rotateIndex = __builtin_ctzll(free);
+				else if (stealMode == STEAL_DEFAULT) {
+					// No notes are available. Advance rotateIndex once more.
 					rotateIndex++;
 					if (rotateIndex >= numChannels)
 						rotateIndex = 0;
-					if (channels[rotateIndex] == nullptr)
-						return rotateIndex;
 				}
-				// No notes are available. Advance rotateIndex once more.
-				rotateIndex++;
-				if (rotateIndex >= numChannels)
-					rotateIndex = 0;
+				else 
+					rotateIndex = getStealChannel();
 				return rotateIndex;
 			} break;
 
 			case RESET_MODE: {
-				for (int c = 0; c < numChannels; c++) {
-					if (channels[c] == nullptr)
-						return c;
-				}
-				return numChannels - 1;
+				if (free)
+					return __builtin_ctzll(free);
+				if (stealMode == STEAL_DEFAULT)
+					return numChannels - 1;
+				return getStealChannel();
 			} break;
 
 			case FIXED_MODE: {
-				return node->id;
+				//nodes past the last enabled bus wrap around
+				int buses = (numChannels + BUS_CHANNELS - 1) / BUS_CHANNELS;
+				return node % (buses * BUS_CHANNELS);
 			} break;
 
 			default: return 0;
 		}
 	}
 
+	//only called when every channel is in use
+	int getStealChannel(){
+		switch (stealMode) {
+			case STEAL_OLDEST: return oldestChannel;
+			case STEAL_NEWEST: return newestChannel;
+			case STEAL_LOWEST_NODE: return nodeChannels[__builtin_ctzll(usedNodes)];
+			case STEAL_ROUND_ROBIN: {
+				stealIndex++;
+				if (stealIndex >= numChannels)
+					stealIndex = 0;
+				return stealIndex;
+			}
+			default: return numChannels - 1;
+		}
+	}
+
+	void openChannel(int ch, int node){
+		channels[ch] = node;
+		nodeChannels[node] = ch;
+		usedChannels |= (uint64_t) 1 << ch;
+		usedNodes |= (uint64_t) 1 << node;
+		knobValues[ch] = nodeKnobs[node];
+		dirtyChannels |= (uint64_t) 1 << ch;
+		if(ch < numChannels) litNodes |= (uint64_t) 1 << node;
+
+		olderChannel[ch] = newestChannel;
+		newerChannel[ch] = -1;
+		if(newestChannel >= 0) newerChannel[newestChannel] = ch;
+		else oldestChannel = ch;
+		newestChannel = ch;
+	}
+
+	//where voices are going, saved with every step of a compiled sequence
+	struct Allocation{
+		int rotateIndex = -1;
+		int stealIndex = -1;
+		//channel and node of each voice, oldest first
+		std::vector<std::pair<int, int>> voices;
+	};
+
+	Allocation getAllocation(){
+		Allocation a;
+		a.rotateIndex = rotateIndex;
+		a.stealIndex = stealIndex;
+		for(int ch = oldestChannel; ch >= 0; ch = newerChannel[ch])
+			a.voices.push_back({ch, channels[ch]});
+		return a;
+	}
+
+	//ends every voice and sets the indexes of an allocation, its voices follow with restoreVoice, oldest first
+	void clearAllocation(int rotate, int steal){
+		for(int ch = 0; ch < MAX_CHANNELS; ch++)
+			closeChannel(ch);
+		rotateIndex = rotate;
+		stealIndex = steal;
+	}
+
+	//a voice already playing, so no retrig
+	void restoreVoice(int ch, int node){
+		if(ch < 0 || ch >= MAX_CHANNELS || node < 0 || node >= MAX_NODES)
+			return;
+		if(nodeChannels[node] >= 0) closeChannel(nodeChannels[node]);
+		closeChannel(ch);
+		openChannel(ch, node);
+		setGate(ch, 10.f);
+	}
+
 	void closeChannel(int ch){
-		gateOut->setVoltage(0.f, ch);
-		if(channels[ch] != nullptr) 
-			channels[ch]->lightBrightness = 0.f;
-		channels[ch] = nullptr;
+		setGate(ch, 0.f);
+		int node = channels[ch];
+		if(node >= 0){
+			litNodes &= ~((uint64_t) 1 << node);
+			nodeChannels[node] = -1;
+			usedChannels &= ~((uint64_t) 1 << ch);
+			usedNodes &= ~((uint64_t) 1 << node);
+
+			int older = olderChannel[ch];
+			int newer = newerChannel[ch];
+			if(older >= 0) newerChannel[older] = newer;
+			else oldestChannel = newer;
+			if(newer >= 0) olderChannel[newer] = older;
+			else newestChannel = older;
+		}
+		channels[ch] = -1;
 	}
 
 
 };
 
-inline void Node::play(){
-	outputRouter->playNode(this);
+inline bool isNetwork(Module* module){
+	return module && (module->model == modelNetwork || module->model == modelNetwork4x2 || module->model == modelNetwork4x8);
 }
 
-inline void Node::stop(){
-	outputRouter->stopNode(this);
-}
+//node grid is fixed at compile time, see the typedefs below
+template <int ROWS, int COLS>
+struct TNetwork : Module {
+	static constexpr int NUM_NODES = ROWS * COLS;
+	//first node of every other row has a bypass button
+	static constexpr int NUM_BYPASSES = (ROWS + 1) / 2;
 
-struct Network : Module {
 	enum ParamIds {
-		ENUMS(VAL_PARAM, 4 * 4),
-		ENUMS(BYPASS_PARAM, 2),
+		ENUMS(VAL_PARAM, NUM_NODES),
+		ENUMS(BYPASS_PARAM, NUM_BYPASSES),
 		ATTENUVERSION_PARAM,
 		BIPOLAR_PARAM,
         RESET_PARAM,
 		NUM_PARAMS
 	};
 	enum InputIds {
-		ENUMS(TRIG_INPUT, NODE_NUM_INS * 4 * 4),
+		ENUMS(TRIG_INPUT, NODE_NUM_INS * NUM_NODES),
 		ATTENUVERSION_INPUT,
         ENUMS(RESET_INPUT,6),
+		SCENE_INPUT,
+		SCENE_TRIG_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
-		ENUMS(TRIG_OUTPUT, NODE_NUM_OUTS * 4 * 4),
+		ENUMS(TRIG_OUTPUT, NODE_NUM_OUTS * NUM_NODES),
 		CV_OUTPUT,
 		GATE_OUTPUT,
 		RETRIG_OUTPUT,
 		NUM_OUTPUTS
 	};
 	enum LightIds {
-		ENUMS(TRIG_LIGHT, 4 * 4),
-		ENUMS(BYPASS_LIGHT, 2),
+		ENUMS(TRIG_LIGHT, NUM_NODES),
+		ENUMS(BYPASS_LIGHT, NUM_BYPASSES),
 		NUM_LIGHTS
 	};
 
-    Node nodes[4*4];
-    OutputRouter outputRouter;
+	//snapshot of everything a sequence is made of
+	struct NetworkScene{
+		bool saved = false;
+		float values[NUM_NODES];
+		float bypass[NUM_BYPASSES];
+		int states[NUM_NODES];
+	};
 
-    dsp::SchmittTrigger resetTriggers[6];
+    Node nodes[NUM_NODES];
+    OutputRouter outputRouter;
+	LinkQueue linkQueue;
+	VoiceQueue voiceQueue;
+	//knob of every node in the chain by chain wide id, read by outputRouter
+	float chainKnobs[MAX_NODES] = {};
+
+	//expander chaining, see NetworkMessage
+	NetworkMessage leftMessages[2] = {};
+	NetworkMessage rightMessages[2] = {};
+	//chain wide id of nodes[0]
+	int nodeOffset = 0;
+	//voices are sent left, to the chain's first module
+	bool chained = false;
+	//this module's voices wait here until they'd reach the chain's first module along with the ones
+	//from the end of the chain, so nodes firing on the same sample in different modules start together
+	struct DelayedVoice{
+		VoiceEvent event;
+		uint32_t due;
+	};
+	DelayedVoice delayedVoices[VOICE_QUEUE_SIZE];
+	size_t delayedStart = 0;
+	size_t delayedEnd = 0;
+	uint32_t sampleCount = 0;
+	//node count of each neighbour, 0 if it's not a Network. for the links menu
+	int leftNodes = 0;
+	int rightNodes = 0;
+	//all changes from other threads go through here
+	SpscQueue<Command, COMMAND_QUEUE_SIZE> commands;
+	//ui thread only, commands dropped since the last one that fit
+	int droppedCommands = 0;
+
+	NetworkScene scenes[NUM_SCENES];
+	//filled by dataFromJson, copied into scenes by the engine
+	NetworkScene stagedScenes[NUM_SCENES];
+	std::atomic<int> stagingState{STAGING_IDLE};
+	int currentScene = -1;
+	dsp::SchmittTrigger sceneTrigger;
+
+	//node states of each clock step from reset, until the sequence repeats.
+	//built by the worker, then read by the ui thread only, see compileSequence
+	struct SequenceTable{
+		bool compiled = false;
+		//steps before the loop, and the length of the loop. length is 0 if no loop was found
+		int intro = 0;
+		int length = 0;
+		std::vector<std::array<int, NUM_NODES>> states;
+		//voice allocation at the start of each step
+		std::vector<OutputRouter::Allocation> allocations;
+	};
+	SequenceTable sequence;
+	//a table the worker has finished, for the ui to take over
+	std::atomic<SequenceTable*> compiledSequence{nullptr};
+	//offline simulations run here, one at a time, so the ui never waits for them
+	std::thread worker;
+	std::atomic<bool> working{false};
+
+    TriggerBank resetTriggers[6];
 	dsp::BooleanTrigger resetBtnTrigger;
 
-    Network() {
+    TNetwork() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);		
         
 		configParam(ATTENUVERSION_PARAM, -1.f, 1.f, 0.4f, "CV Attenuversion", "%", 0, 100);
         configParam(BIPOLAR_PARAM, 0.f, 1.f, 1.f, "CV Bipolar");		
         configParam(RESET_PARAM, 0.f, 1.f, 0.f, "Reset");	
-		configParam(BYPASS_PARAM, 0.f, 1.f, 0.f, "Bypass");	
-		configParam(BYPASS_PARAM+1, 0.f, 1.f, 0.f, "Bypass");	
+		for(int i = 0; i < NUM_BYPASSES; i++)
+			configParam(BYPASS_PARAM+i, 0.f, 1.f, 0.f, "Bypass");	
        
-	    outputRouter.init(&outputs[CV_OUTPUT], &outputs[GATE_OUTPUT], &outputs[RETRIG_OUTPUT]);
+	    outputRouter.init(&outputs[CV_OUTPUT], &outputs[GATE_OUTPUT], &outputs[RETRIG_OUTPUT], chainKnobs);
+
+		leftExpander.producerMessage = &leftMessages[0];
+		leftExpander.consumerMessage = &leftMessages[1];
+		rightExpander.producerMessage = &rightMessages[0];
+		rightExpander.consumerMessage = &rightMessages[1];
         
 		int bypass = 0;
-		for(int i = 0; i < 4*4; i++){
+		for(int i = 0; i < NUM_NODES; i++){
             configParam(VAL_PARAM + i, 0.f, 1.f, 0.5f, string::f("Node %d", i+1));		
             nodes[i].init(i, 
                 &params[VAL_PARAM+i], 
                 &lights[TRIG_LIGHT+i], 
                 &inputs[TRIG_INPUT+(i*NODE_NUM_INS)], 
                 &outputs[TRIG_OUTPUT+(i*NODE_NUM_OUTS)], 
-                &outputRouter,
-				(i == 0 or i == 8) ? &params[BYPASS_PARAM+bypass++] : nullptr
+                &voiceQueue,
+				&linkQueue,
+				(i % (COLS * 2) == 0) ? &params[BYPASS_PARAM+bypass++] : nullptr
             );
 
         }
 
     }
 
+	~TNetwork(){
+		if(worker.joinable())
+			worker.join();
+		delete compiledSequence.exchange(nullptr);
+	}
+
+	Node* getBypassNode(int n){
+		return &nodes[n * COLS * 2];
+	}
+
 	void resetNodes(){
-		for(int node = 0; node < 16; node++)
+		for(int node = 0; node < NUM_NODES; node++)
 			nodes[node].reset();
 	}
+
+	//call from the ui thread only. false if the queue was full and the command was dropped,
+	//e.g. presets loaded faster than the engine takes them, or while it's stopped
+	bool pushCommand(CommandType type, int value, int node = 0, int out = 0){
+		if(commands.push({type, value, node, out})){
+			droppedCommands = 0;
+			return true;
+		}
+		//once per run of drops, a preset can lose hundreds
+		if(droppedCommands++ == 0)
+			WARN("Network command queue is full, changes are being dropped");
+		return false;
+	}
+
+	void applyCommand(const Command& c){
+		switch (c.type) {
+			case SET_CHANNELS_COMMAND: outputRouter.setChannels(c.value); break;
+			case SET_POLY_MODE_COMMAND: outputRouter.setPolyMode((PolyMode) c.value); break;
+			case SET_STEAL_MODE_COMMAND: outputRouter.setStealMode((StealMode) c.value); break;
+			case SET_NODE_STATE_COMMAND: nodes[c.node].setState(c.value); break;
+			case SET_LINK_COMMAND: nodes[c.node].links[c.out] = c.value; break;
+			case SET_LINK_HOPS_COMMAND: nodes[c.node].linkHops[c.out] = c.value; break;
+			case SAVE_SCENE_COMMAND: saveScene(c.value); break;
+			case LOAD_SCENE_COMMAND: loadScene(c.value); break;
+			case SET_QUANTIZE_ROOT_COMMAND: outputRouter.setQuantize(c.value, outputRouter.quantizeMode); break;
+			case SET_QUANTIZE_MODE_COMMAND: outputRouter.setQuantize(outputRouter.quantizeRoot, c.value); break;
+			case SET_GLIDE_TIME_COMMAND: outputRouter.setGlide(c.value, outputRouter.glideCurve); break;
+			case SET_GLIDE_CURVE_COMMAND: outputRouter.setGlide(outputRouter.glideTime, (GlideCurve) c.value); break;
+			//rotate index in value, steal index in node.
+			//voices of a chained module belong to the chain's first module, a seek leaves them be.
+			//voice changes from the seek's node states are dropped, the allocation replaces them
+			case SEEK_ALLOCATION_COMMAND:
+				if(not chained){
+					voiceQueue.clear();
+					delayedStart = delayedEnd;
+					outputRouter.clearAllocation(c.value, c.node);
+				}
+				break;
+			case SEEK_VOICE_COMMAND: if(not chained) outputRouter.restoreVoice(c.value, c.node); break;
+		}
+	}
+
+	void saveScene(int n){
+		NetworkScene* scene = &scenes[n];
+		for(int node = 0; node < NUM_NODES; node++){
+			scene->values[node] = params[VAL_PARAM+node].getValue();
+			scene->states[node] = nodes[node].state;
+		}
+		for(int i = 0; i < NUM_BYPASSES; i++)
+			scene->bypass[i] = params[BYPASS_PARAM+i].getValue();
+		scene->saved = true;
+		currentScene = n;
+	}
+
+	void loadScene(int n){
+		currentScene = n;
+		NetworkScene* scene = &scenes[n];
+		if(not scene->saved)
+			return;
+		for(int node = 0; node < NUM_NODES; node++){
+			params[VAL_PARAM+node].setValue(scene->values[node]);
+			nodes[node].setState(scene->states[node]);
+		}
+		for(int i = 0; i < NUM_BYPASSES; i++)
+			params[BYPASS_PARAM+i].setValue(scene->bypass[i]);
+	}
+
+	void processScenes(){
+		//take over scenes from a freshly loaded preset
+		int pending = STAGING_PENDING;
+		if(stagingState.compare_exchange_strong(pending, STAGING_COPYING)){
+			std::copy(stagedScenes, stagedScenes + NUM_SCENES, scenes);
+			stagingState = STAGING_IDLE;
+		}
+
+		//with the trigger patched, scene cv is only sampled on a trigger
+		bool sample = true;
+		if(inputs[SCENE_TRIG_INPUT].isConnected()){
+			float val = inputs[SCENE_TRIG_INPUT].getVoltage();
+			val = rescale(val, 0.1f, 2.f, 0.f, 1.f);//obey voltage stadards for triggers
+			sample = sceneTrigger.process(val);
+		}
+
+		if(sample && inputs[SCENE_INPUT].isConnected()){
+			int scene = (int) (inputs[SCENE_INPUT].getVoltage() / 10.f * NUM_SCENES);
+			scene = clamp(scene, 0, NUM_SCENES - 1);
+			if(scene != currentScene)
+				loadScene(scene);
+		}
+	}
+
+	//scratch copy of this module with the same knobs, links and outputs, starting from reset.
+	//clocked is filled with every node input that's patched from outside the module
+	TNetwork* createSimulation(const std::vector<RenderCable>& cables, bool* clocked){
+		TNetwork* sim = new TNetwork;
+		for(int i = 0; i < NUM_PARAMS; i++)
+			sim->params[i].setValue(params[i].getValue());
+		json_t* rootJ = dataToJson();
+		sim->dataFromJson(rootJ);
+		json_decref(rootJ);
+		Command command;
+		while(sim->commands.pop(command))
+			sim->applyCommand(command);
+		sim->resetNodes();
+		//as if it had been running a while with its inputs low, or the nodes would ignore the first clock
+		for(int node = 0; node < NUM_NODES; node++){
+			sim->nodes[node].suppressTrigsTimer.time = 1.f;
+			for(int in = 0; in < NODE_NUM_INS; in++)
+				sim->nodes[node].inputTriggers[in].reset();
+		}
+
+		//outputs patched anywhere still count as connected, so rests work
+		for(int i = 0; i < NUM_OUTPUTS; i++)
+			sim->outputs[i].channels = outputs[i].channels;
+		sim->outputs[CV_OUTPUT].channels = 1;
+		sim->outputs[GATE_OUTPUT].channels = 1;
+		sim->outputs[RETRIG_OUTPUT].channels = 1;
+		sim->inputs[ATTENUVERSION_INPUT] = inputs[ATTENUVERSION_INPUT];
+
+		for(int i = 0; i < NUM_INPUTS; i++)
+			clocked[i] = false;
+		for(int i = 0; i < NODE_NUM_INS * NUM_NODES; i++)
+			clocked[TRIG_INPUT+i] = inputs[TRIG_INPUT+i].isConnected();
+		for(const RenderCable& c : cables)
+			clocked[c.inputId] = false;
+		for(int i = 0; i < NUM_INPUTS; i++)
+			if(clocked[i]) sim->inputs[i].channels = 1;
+		return sim;
+	}
+
+	//one sample of a simulation, sample s of a clock step
+	static void simulateSample(TNetwork* sim, const ProcessArgs& args, int s, const bool* clocked, const std::vector<RenderCable>& cables){
+		float clock = s < RENDER_STEP_SAMPLES / 2 ? 10.f : 0.f;
+		for(int i = 0; i < NUM_INPUTS; i++)
+			if(clocked[i]) sim->inputs[i].setVoltage(clock);
+
+		sim->process(args);
+
+		//cables deliver on the next sample, same as in the engine
+		for(const RenderCable& c : cables){
+			Output* out = &sim->outputs[c.outputId];
+			Input* in = &sim->inputs[c.inputId];
+			in->channels = out->getChannels();
+			for(int ch = 0; ch < 16; ch++)
+				in->setVoltage(ch < in->channels ? out->getVoltage(ch) : 0.f, ch);
+		}
+	}
+
+	static ProcessArgs getSimulationArgs(){
+		ProcessArgs args;
+		args.sampleRate = RENDER_SAMPLE_RATE;
+		args.sampleTime = 1.f / RENDER_SAMPLE_RATE;
+		return args;
+	}
+
+	//call from the ui thread. runs work(sim, clocked, cables) on the worker, with a simulation
+	//of this module as it is now and its self-patched cables. false if the worker is busy
+	template <typename F>
+	bool startSimulation(const std::vector<RenderCable>& cables, F work){
+		if(working)
+			return false;
+		if(worker.joinable())
+			worker.join();
+
+		bool* clocked = new bool[NUM_INPUTS];
+		TNetwork* sim = createSimulation(cables, clocked);
+		working = true;
+		worker = std::thread([this, sim, clocked, cables, work](){
+			work(sim, clocked, cables);
+			delete sim;
+			delete[] clocked;
+			working = false;
+		});
+		return true;
+	}
+
+	//render the sequence from reset into a csv file, one row per clock step
+	bool renderSequence(std::string path, int steps, const std::vector<RenderCable>& cables){
+		int numChannels = outputRouter.numChannels;
+		return startSimulation(cables, [path, steps, numChannels](TNetwork* sim, const bool* clocked, const std::vector<RenderCable>& cables){
+			FILE* file = std::fopen(path.c_str(), "w");
+			if(!file){
+				WARN("Network could not write %s", path.c_str());
+				return;
+			}
+			renderSimulation(sim, file, steps, numChannels, clocked, cables);
+			std::fclose(file);
+		});
+	}
+
+	static void renderSimulation(TNetwork* sim, FILE* file, int steps, int numChannels, const bool* clocked, const std::vector<RenderCable>& cables){
+		std::fprintf(file, "step");
+		for(int ch = 0; ch < numChannels; ch++)
+			std::fprintf(file, ",cv %d,gate %d,retrig %d", ch+1, ch+1, ch+1);
+		std::fprintf(file, "\n");
+
+		ProcessArgs args = getSimulationArgs();
+		float cv[MAX_CHANNELS] = {};
+		float gate[MAX_CHANNELS] = {};
+		bool retrig[MAX_CHANNELS];
+
+		for(int step = 0; step < steps; step++){
+			for(int ch = 0; ch < MAX_CHANNELS; ch++) retrig[ch] = false;
+
+			for(int s = 0; s < RENDER_STEP_SAMPLES; s++){
+				simulateSample(sim, args, s, clocked, cables);
+
+				//the router keeps every bus, not just the one on the outputs
+				OutputRouter* router = &sim->outputRouter;
+				for(int ch = 0; ch < numChannels; ch++)
+					if(router->retrigValues[ch] > 0.f) retrig[ch] = true;
+
+				//sample voices at the end of the clock pulse, once cable chains have settled
+				if(s == RENDER_STEP_SAMPLES / 2 - 1){
+					for(int ch = 0; ch < numChannels; ch++){
+						cv[ch] = router->cvValues[ch];
+						gate[ch] = router->gateValues[ch];
+					}
+				}
+			}
+
+			std::fprintf(file, "%d", step+1);
+			for(int ch = 0; ch < numChannels; ch++)
+				std::fprintf(file, ",%g,%g,%d", cv[ch], gate[ch], retrig[ch] ? 10 : 0);
+			std::fprintf(file, "\n");
+		}
+	}
+
+	//everything that decides what the next clock steps will play:
+	//node states, pending resets and the voice allocation, oldest voice first
+	std::vector<int> getSequenceState(){
+		std::vector<int> key;
+		for(int node = 0; node < NUM_NODES; node++){
+			key.push_back(nodes[node].state);
+			key.push_back(nodes[node].doReset);
+		}
+		OutputRouter::Allocation allocation = outputRouter.getAllocation();
+		key.push_back(allocation.rotateIndex);
+		key.push_back(allocation.stealIndex);
+		for(const std::pair<int, int>& voice : allocation.voices){
+			key.push_back(voice.first);
+			key.push_back(voice.second);
+		}
+		return key;
+	}
+
+	//clock a simulation from reset until its state repeats, recording the node states and voices of every step.
+	//the sequence is deterministic for a given patch, so it has to loop eventually.
+	//runs on the worker, the table is picked up by takeSequence
+	bool compileSequence(const std::vector<RenderCable>& cables){
+		bool started = startSimulation(cables, [this](TNetwork* sim, const bool* clocked, const std::vector<RenderCable>& cables){
+			ProcessArgs args = getSimulationArgs();
+			SequenceTable* table = new SequenceTable;
+			table->compiled = true;
+			std::map<std::vector<int>, int> seen;
+			for(int step = 0; step <= MAX_SEQUENCE_STEPS; step++){
+				std::vector<int> key = sim->getSequenceState();
+				auto it = seen.find(key);
+				if(it != seen.end()){
+					table->intro = it->second;
+					table->length = step - it->second;
+					break;
+				}
+				seen[key] = step;
+
+				std::array<int, NUM_NODES> states;
+				for(int node = 0; node < NUM_NODES; node++)
+					states[node] = sim->nodes[node].doReset ? -2 : sim->nodes[node].state;
+				table->states.push_back(states);
+				table->allocations.push_back(sim->outputRouter.getAllocation());
+
+				for(int s = 0; s < RENDER_STEP_SAMPLES; s++)
+					simulateSample(sim, args, s, clocked, cables);
+			}
+			delete compiledSequence.exchange(table);
+		});
+		//the old table is for a patch that may have changed
+		if(started)
+			sequence = SequenceTable();
+		return started;
+	}
+
+	//call from the ui thread, takes over a table the worker has finished
+	void takeSequence(){
+		SequenceTable* table = compiledSequence.exchange(nullptr);
+		if(table){
+			sequence = std::move(*table);
+			delete table;
+		}
+	}
+
+	//jump to a step of the compiled sequence, the next clock plays the step after it.
+	//node states first, then the voices, so the voices aren't ended by the nodes leaving theirs.
+	//call from the ui thread only
+	void seekSequence(int step){
+		if(step < 0 || step >= (int) sequence.states.size())
+			return;
+		for(int node = 0; node < NUM_NODES; node++)
+			pushCommand(SET_NODE_STATE_COMMAND, sequence.states[step][node], node);
+		const OutputRouter::Allocation& allocation = sequence.allocations[step];
+		pushCommand(SEEK_ALLOCATION_COMMAND, allocation.rotateIndex, allocation.stealIndex);
+		for(const std::pair<int, int>& voice : allocation.voices)
+			pushCommand(SEEK_VOICE_COMMAND, voice.first, voice.second);
+	}
 		
 
     void process(const ProcessArgs& args) override {
+
+		Command command;
+		while(commands.pop(command))
+			applyCommand(command);
+
+		processScenes();
         
 		if(resetBtnTrigger.process(params[RESET_PARAM].getValue()))
 			resetNodes();
 
+		//unpatched reset inputs cost nothing, only the first channel resets
 		for(int i = 0; i < 6; i++){	
-			float val = inputs[RESET_INPUT+i].getVoltage();	
-			val = rescale(val, 0.1f, 2.f, 0.f, 1.f);//obey voltage stadards for triggers
-			if(resetTriggers[i].process(val))
+			if(resetTriggers[i].process(&inputs[RESET_INPUT+i], 0x1))
 				resetNodes();		
 		}
 
-        outputRouter.process(
-			args.sampleTime,
-			params[BIPOLAR_PARAM].getValue() > 0.f,
-			inputs[ATTENUVERSION_INPUT].isConnected() ?
-			inputs[ATTENUVERSION_INPUT].getVoltage()/10 :
-			params[ATTENUVERSION_PARAM].getValue()
-		);
-        
-        for(int node = 0; node < 4*4; node++){			
+		//what the neighbouring Networks sent last sample
+		NetworkMessage* fromLeft = isNetwork(leftExpander.module) ? (NetworkMessage*) leftExpander.consumerMessage : nullptr;
+		NetworkMessage* fromRight = isNetwork(rightExpander.module) ? (NetworkMessage*) rightExpander.consumerMessage : nullptr;
+		NetworkMessage* toLeft = fromLeft ? (NetworkMessage*) leftExpander.module->rightExpander.producerMessage : nullptr;
+		NetworkMessage* toRight = fromRight ? (NetworkMessage*) rightExpander.module->leftExpander.producerMessage : nullptr;
+		leftNodes = fromLeft ? fromLeft->numNodes : 0;
+		rightNodes = fromRight ? fromRight->numNodes : 0;
+
+		//share the left module's voices, if its allocator has room for our nodes
+		bool wasChained = chained;
+		//a message that's still all zeros, from a neighbour that hasn't run yet, isn't a chain
+		chained = fromLeft && fromLeft->numNodes > 0 && fromLeft->nodeOffset >= 0 && fromLeft->nodeOffset + NUM_NODES <= MAX_NODES;
+		nodeOffset = chained ? fromLeft->nodeOffset : 0;
+		if(chained && not wasChained) outputRouter.stopNodesFrom(0);
+		//voices take a sample per module to travel left, the further right the less they wait
+		int chainPosition = chained ? fromLeft->chainPosition : 0;
+		int chainDepth = 1 + (fromRight && fromRight->chained ? fromRight->chainDepth : 0);
+		int chainModules = chained ? fromLeft->chainModules : chainDepth;
+		int voiceDelay = clamp(chainModules - 1 - chainPosition, 0, MAX_CHAIN_MODULES - 1);
+
+		receiveLinks(fromLeft, fromRight);
+
+        for(int node = 0; node < NUM_NODES; node++){			
             nodes[node].process(args.sampleTime);
         }
-		lights[BYPASS_LIGHT].setSmoothBrightness(nodes[0].isBypass() ? 1.f : 0.f, args.sampleTime);
-		lights[BYPASS_LIGHT+1].setSmoothBrightness(nodes[8].isBypass() ? 1.f : 0.f, args.sampleTime);
+
+		//resolve internal links within this sample.
+		//capped, so a feedback loop of links can't stall the engine
+		for(int i = 0; i < LINK_QUEUE_SIZE && not linkQueue.empty(); i++){
+			LinkEvent e = linkQueue.shift();
+			if(e.target < NUM_NODES) nodes[e.target].processLink(e.high);
+		}
+		//a link event dropped from a full queue would leave its target's count wrong for good
+		if(linkQueue.empty())
+			checkLinks();
+		sendLinks(fromLeft, fromRight, toLeft, toRight);
+
+		for(int i = 0; i < NUM_NODES; i++)
+			chainKnobs[nodeOffset + i] = params[VAL_PARAM+i].getValue();
+		//knobs of the rest of the chain come from the right
+		int chainEnd = nodeOffset + NUM_NODES;
+		if(fromRight && fromRight->chained && fromRight->chainEnd > chainEnd){
+			int end = std::min(fromRight->chainEnd, MAX_NODES);
+			std::copy(fromRight->knobs + chainEnd, fromRight->knobs + end, chainKnobs + chainEnd);
+			chainEnd = end;
+		}
+
+		if(chained){
+			toLeft->chained = true;
+			toLeft->chainEnd = chainEnd;
+			toLeft->chainDepth = chainDepth;
+			std::copy(chainKnobs + nodeOffset, chainKnobs + chainEnd, toLeft->knobs + nodeOffset);
+			toLeft->numVoices = 0;
+			if(fromRight && fromRight->chained){
+				for(int i = 0; i < fromRight->numVoices && toLeft->numVoices < VOICE_QUEUE_SIZE; i++)
+					toLeft->voices[toLeft->numVoices++] = fromRight->voices[i];
+			}
+			delayVoices(voiceDelay);
+			VoiceEvent e;
+			while(popVoice(e)){
+				if(toLeft->numVoices < VOICE_QUEUE_SIZE)
+					toLeft->voices[toLeft->numVoices++] = {e.node + nodeOffset, e.play};
+			}
+			processBus(fromLeft);
+		}
+		else{
+			if(toLeft){
+				toLeft->chained = false;
+				toLeft->numVoices = 0;
+			}
+			if(fromRight && fromRight->chained){
+				for(int i = 0; i < fromRight->numVoices; i++)
+					outputRouter.applyVoice(fromRight->voices[i]);
+			}
+			delayVoices(voiceDelay);
+			VoiceEvent e;
+			while(popVoice(e))
+				outputRouter.applyVoice(e);
+			//nodes that have left the chain
+			outputRouter.stopNodesFrom(chainEnd);
+
+			//important that this happens after the nodes,
+			//so a new voice's cv and retrig arrive on the same sample as its gate
+			outputRouter.process(
+				args.sampleTime,
+				params[BIPOLAR_PARAM].getValue() > 0.f,
+				inputs[ATTENUVERSION_INPUT].isConnected() ?
+				inputs[ATTENUVERSION_INPUT].getVoltage()/10 :
+				params[ATTENUVERSION_PARAM].getValue()
+			);
+		}
+
+		uint64_t lit = chained ? fromLeft->litNodes : outputRouter.litNodes;
+		for(int i = 0; i < NUM_NODES; i++)
+			nodes[i].lightBrightness = (lit >> (nodeOffset + i)) & 1 ? 1.f : 0.f;
+
+		if(toLeft){
+			toLeft->numNodes = NUM_NODES;
+			leftExpander.module->rightExpander.messageFlipRequested = true;
+		}
+		if(toRight){
+			toRight->nodeOffset = nodeOffset + NUM_NODES;
+			toRight->chainModules = chainModules;
+			toRight->chainPosition = chainPosition + 1;
+			toRight->litNodes = lit;
+			toRight->numNodes = NUM_NODES;
+			sendBuses(toRight, fromLeft);
+			rightExpander.module->leftExpander.messageFlipRequested = true;
+		}
+
+		for(int i = 0; i < NUM_BYPASSES; i++)
+			lights[BYPASS_LIGHT+i].setSmoothBrightness(getBypassNode(i)->isBypass() ? 1.f : 0.f, args.sampleTime);
     }
 
+	//call once a sample, queued voices become due delay samples from now
+	void delayVoices(int delay){
+		while(not voiceQueue.empty() && delayedEnd - delayedStart < VOICE_QUEUE_SIZE)
+			delayedVoices[delayedEnd++ % VOICE_QUEUE_SIZE] = {voiceQueue.shift(), sampleCount + delay};
+		sampleCount++;
+	}
+
+	//the oldest delayed voice, if it's due
+	bool popVoice(VoiceEvent& e){
+		if(delayedStart == delayedEnd)
+			return false;
+		const DelayedVoice& d = delayedVoices[delayedStart % VOICE_QUEUE_SIZE];
+		if((int32_t) (d.due - sampleCount) >= 0)
+			return false;
+		e = d.event;
+		delayedStart++;
+		return true;
+	}
+
+	//output this module's bus of the chain's voices
+	void processBus(NetworkMessage* fromLeft){
+		int first = fromLeft->busIndex * BUS_CHANNELS;
+		int channels = clamp(fromLeft->numChannels - first, 0, BUS_CHANNELS);
+		outputs[CV_OUTPUT].setChannels(channels);
+		outputs[GATE_OUTPUT].setChannels(channels);
+		outputs[RETRIG_OUTPUT].setChannels(channels);
+		for(int c = 0; c < channels; c += 4){
+			outputs[CV_OUTPUT].setVoltageSimd(simd::float_4::load(&fromLeft->cv[first + c]), c);
+			outputs[GATE_OUTPUT].setVoltageSimd(simd::float_4::load(&fromLeft->gate[first + c]), c);
+			outputs[RETRIG_OUTPUT].setVoltageSimd(simd::float_4::load(&fromLeft->retrig[first + c]), c);
+		}
+	}
+
+	//pass the voices of the buses further along the chain to the right
+	void sendBuses(NetworkMessage* toRight, NetworkMessage* fromLeft){
+		int bus = chained ? fromLeft->busIndex : 0;
+		int numChannels = chained ? fromLeft->numChannels : outputRouter.numChannels;
+		const float* cv = chained ? fromLeft->cv : outputRouter.cvValues;
+		const float* gate = chained ? fromLeft->gate : outputRouter.gateValues;
+		const float* retrig = chained ? fromLeft->retrig : outputRouter.retrigValues;
+
+		int first = std::min((bus + 1) * BUS_CHANNELS, MAX_CHANNELS);
+		int last = std::max(numChannels, first);
+		toRight->busIndex = bus + 1;
+		toRight->numChannels = numChannels;
+		std::copy(cv + first, cv + last, toRight->cv + first);
+		std::copy(gate + first, gate + last, toRight->gate + first);
+		std::copy(retrig + first, retrig + last, toRight->retrig + first);
+	}
+
+	//links from a neighbour's nodes join this sample's link queue
+	//count the links held high on this module's nodes by the neighbours
+	void receiveLinks(NetworkMessage* fromLeft, NetworkMessage* fromRight){
+		int high[NUM_NODES] = {};
+		for(NetworkMessage* message : {fromLeft, fromRight}){
+			if(not message) continue;
+			for(int i = 0; i < message->numLinks; i++){
+				const LinkEvent& e = message->links[i];
+				if(e.hops == 0 && e.target >= 0 && e.target < NUM_NODES) high[e.target]++;
+			}
+		}
+		for(int i = 0; i < NUM_NODES; i++)
+			nodes[i].setLinksHigh(nodes[i].linksHigh, high[i]);
+	}
+
+	//with no link events pending, every node's count of links from this module should match the nodes holding them
+	void checkLinks(){
+		int high[NUM_NODES] = {};
+		for(int i = 0; i < NUM_NODES; i++){
+			const Node& n = nodes[i];
+			if(n.activeTarget >= 0 && n.activeTarget < NUM_NODES && n.activeHops == 0) high[n.activeTarget]++;
+		}
+		for(int i = 0; i < NUM_NODES; i++)
+			nodes[i].setLinksHigh(high[i], nodes[i].remoteLinksHigh);
+	}
+
+	//links held high by this module's nodes, and the ones passing through from further along the chain
+	void sendLinks(NetworkMessage* fromLeft, NetworkMessage* fromRight, NetworkMessage* toLeft, NetworkMessage* toRight){
+		auto send = [](NetworkMessage* to, LinkEvent e){
+			if(to && to->numLinks < LINK_QUEUE_SIZE)
+				to->links[to->numLinks++] = e;
+		};
+		if(toLeft) toLeft->numLinks = 0;
+		if(toRight) toRight->numLinks = 0;
+		for(int i = 0; i < NUM_NODES; i++){
+			const Node& n = nodes[i];
+			if(n.activeTarget < 0) continue;
+			if(n.activeHops > 0) send(toRight, {n.activeTarget, true, n.activeHops - 1});
+			else if(n.activeHops < 0) send(toLeft, {n.activeTarget, true, n.activeHops + 1});
+		}
+		if(fromLeft){
+			for(int i = 0; i < fromLeft->numLinks; i++)
+				if(fromLeft->links[i].hops > 0) send(toRight, {fromLeft->links[i].target, true, fromLeft->links[i].hops - 1});
+		}
+		if(fromRight){
+			for(int i = 0; i < fromRight->numLinks; i++)
+				if(fromRight->links[i].hops < 0) send(toLeft, {fromRight->links[i].target, true, fromRight->links[i].hops + 1});
+		}
+	}
+
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "channels", json_integer(outputRouter.numChannels));
 		json_object_set_new(rootJ, "polyMode", json_integer(outputRouter.polyMode));
+		json_object_set_new(rootJ, "stealMode", json_integer(outputRouter.stealMode));
+		json_object_set_new(rootJ, "quantizeRoot", json_integer(outputRouter.quantizeRoot));
+		json_object_set_new(rootJ, "quantizeMode", json_integer(outputRouter.quantizeMode));
+		json_object_set_new(rootJ, "glideTime", json_integer(outputRouter.glideTime));
+		json_object_set_new(rootJ, "glideCurve", json_integer(outputRouter.glideCurve));
 
 		json_t *nodeStatesJ = json_array();
-		for (int node = 0; node < 16; node++) {
+		for (int node = 0; node < NUM_NODES; node++) {
 			json_t *nodeStateJ = json_integer((int) nodes[node].state);
 			json_array_append_new(nodeStatesJ, nodeStateJ);
 		}
 		json_object_set_new(rootJ, "nodeStates", nodeStatesJ);
 
+		json_t *linksJ = json_array();
+		for (int node = 0; node < NUM_NODES; node++) {
+			json_t *nodeLinksJ = json_array();
+			for (int out = 0; out < NODE_NUM_OUTS; out++)
+				json_array_append_new(nodeLinksJ, json_integer(nodes[node].links[out]));
+			json_array_append_new(linksJ, nodeLinksJ);
+		}
+		json_object_set_new(rootJ, "links", linksJ);
+
+		json_t *linkHopsJ = json_array();
+		for (int node = 0; node < NUM_NODES; node++) {
+			json_t *nodeHopsJ = json_array();
+			for (int out = 0; out < NODE_NUM_OUTS; out++)
+				json_array_append_new(nodeHopsJ, json_integer(nodes[node].linkHops[out]));
+			json_array_append_new(linkHopsJ, nodeHopsJ);
+		}
+		json_object_set_new(rootJ, "linkHops", linkHopsJ);
+
+		json_t *scenesJ = json_array();
+		for (int n = 0; n < NUM_SCENES; n++) {
+			NetworkScene* scene = &scenes[n];
+			if (not scene->saved)
+				continue;
+			json_t *sceneJ = json_object();
+			json_object_set_new(sceneJ, "scene", json_integer(n));
+			json_t *valuesJ = json_array();
+			json_t *statesJ = json_array();
+			for (int node = 0; node < NUM_NODES; node++) {
+				json_array_append_new(valuesJ, json_real(scene->values[node]));
+				json_array_append_new(statesJ, json_integer(scene->states[node]));
+			}
+			json_t *bypassJ = json_array();
+			for (int i = 0; i < NUM_BYPASSES; i++)
+				json_array_append_new(bypassJ, json_real(scene->bypass[i]));
+			json_object_set_new(sceneJ, "values", valuesJ);
+			json_object_set_new(sceneJ, "states", statesJ);
+			json_object_set_new(sceneJ, "bypass", bypassJ);
+			json_array_append_new(scenesJ, sceneJ);
+		}
+		json_object_set_new(rootJ, "scenes", scenesJ);
+
 		return rootJ;
 	}
 
 	void dataFromJson(json_t* rootJ) override {
+		//the engine may be running, so everything is applied through the command queue
 		json_t* channelsJ = json_object_get(rootJ, "channels");
 		if (channelsJ)
-			outputRouter.setChannels(json_integer_value(channelsJ));
+			pushCommand(SET_CHANNELS_COMMAND, clamp((int) json_integer_value(channelsJ), 1, MAX_CHANNELS));
 
 		json_t* polyModeJ = json_object_get(rootJ, "polyMode");
 		if (polyModeJ)
-			outputRouter.setPolyMode((PolyMode) json_integer_value(polyModeJ));
+			pushCommand(SET_POLY_MODE_COMMAND, clamp((int) json_integer_value(polyModeJ), 0, NUM_POLY_MODES - 1));
+
+		json_t* stealModeJ = json_object_get(rootJ, "stealMode");
+		if (stealModeJ)
+			pushCommand(SET_STEAL_MODE_COMMAND, clamp((int) json_integer_value(stealModeJ), 0, NUM_STEAL_MODES - 1));
+		json_t* quantizeRootJ = json_object_get(rootJ, "quantizeRoot");
+		if (quantizeRootJ)
+			pushCommand(SET_QUANTIZE_ROOT_COMMAND, clamp((int) json_integer_value(quantizeRootJ), 0, 11));
+		json_t* quantizeModeJ = json_object_get(rootJ, "quantizeMode");
+		if (quantizeModeJ)
+			pushCommand(SET_QUANTIZE_MODE_COMMAND, clamp((int) json_integer_value(quantizeModeJ), -1, NUM_MODES - 1));
+		json_t* glideTimeJ = json_object_get(rootJ, "glideTime");
+		if (glideTimeJ)
+			pushCommand(SET_GLIDE_TIME_COMMAND, clamp((int) json_integer_value(glideTimeJ), 0, 10000));
+		json_t* glideCurveJ = json_object_get(rootJ, "glideCurve");
+		if (glideCurveJ)
+			pushCommand(SET_GLIDE_CURVE_COMMAND, clamp((int) json_integer_value(glideCurveJ), 0, NUM_GLIDE_CURVES - 1));
 		
 		json_t *nodeStatesJ = json_object_get(rootJ, "nodeStates");
 		if (nodeStatesJ) {
-			for (int node = 0; node < 16; node++) {
+			for (int node = 0; node < NUM_NODES; node++) {
 				json_t *nodeStateJ = json_array_get(nodeStatesJ, node);
 				if (nodeStateJ)
-					nodes[node].state = json_integer_value(nodeStateJ);
+					pushCommand(SET_NODE_STATE_COMMAND, clamp((int) json_integer_value(nodeStateJ), -2, NODE_NUM_OUTS - 1), node);
+			}
+		}
+
+		json_t *linksJ = json_object_get(rootJ, "links");
+		json_t *linkHopsJ = json_object_get(rootJ, "linkHops");
+		for (int node = 0; node < NUM_NODES; node++) {
+			json_t *nodeLinksJ = json_array_get(linksJ, node);
+			json_t *nodeHopsJ = json_array_get(linkHopsJ, node);
+			for (int out = 0; out < NODE_NUM_OUTS; out++) {
+				json_t *linkJ = json_array_get(nodeLinksJ, out);
+				json_t *hopsJ = json_array_get(nodeHopsJ, out);
+				int hops = hopsJ ? clamp((int) json_integer_value(hopsJ), -1, 1) : 0;
+				//neighbours may be bigger than this module
+				int maxTarget = hops ? MAX_NODES - 1 : NUM_NODES - 1;
+				pushCommand(SET_LINK_HOPS_COMMAND, hops, node, out);
+				pushCommand(SET_LINK_COMMAND, linkJ ? clamp((int) json_integer_value(linkJ), -1, maxTarget) : -1, node, out);
 			}
 		}
+
+		//reclaim the staging bank if the engine hasn't picked up the last preset yet
+		int pending = STAGING_PENDING;
+		if (not stagingState.compare_exchange_strong(pending, STAGING_IDLE)) {
+			while (stagingState != STAGING_IDLE);
+		}
+
+		for (int n = 0; n < NUM_SCENES; n++)
+			stagedScenes[n].saved = false;
+
+		json_t *scenesJ = json_object_get(rootJ, "scenes");
+		for (size_t i = 0; i < json_array_size(scenesJ); i++) {
+			json_t *sceneJ = json_array_get(scenesJ, i);
+			json_t *indexJ = json_object_get(sceneJ, "scene");
+			if (not indexJ)
+				continue;
+			int n = json_integer_value(indexJ);
+			if (n < 0 || n >= NUM_SCENES)
+				continue;
+			NetworkScene* scene = &stagedScenes[n];
+			json_t *valuesJ = json_object_get(sceneJ, "values");
+			json_t *statesJ = json_object_get(sceneJ, "states");
+			json_t *bypassJ = json_object_get(sceneJ, "bypass");
+			for (int node = 0; node < NUM_NODES; node++) {
+				json_t *valueJ = json_array_get(valuesJ, node);
+				json_t *stateJ = json_array_get(statesJ, node);
+				scene->values[node] = valueJ ? json_number_value(valueJ) : 0.5f;
+				scene->states[node] = stateJ ? clamp((int) json_integer_value(stateJ), -2, NODE_NUM_OUTS - 1) : -2;
+			}
+			for (int b = 0; b < NUM_BYPASSES; b++) {
+				json_t *valueJ = json_array_get(bypassJ, b);
+				scene->bypass[b] = valueJ ? json_number_value(valueJ) : 0.f;
+			}
+			scene->saved = true;
+		}
+		stagingState = STAGING_PENDING;
 	}
 
 	
 
 };
 
+typedef TNetwork<4, 2> Network4x2;
+typedef TNetwork<4, 4> Network;
+typedef TNetwork<4, 8> Network4x8;
+
+template <class TModule>
 struct ChannelValueItem : MenuItem {
-	Network* module;
+	TModule* module;
 	int channels;
 	void onAction(const event::Action& e) override {
-		module->outputRouter.setChannels(channels);
+		module->pushCommand(SET_CHANNELS_COMMAND, channels);
 	}
 };
 
 
+template <class TModule>
 struct ChannelItem : MenuItem {
-	Network* module;
+	TModule* module;
 	Menu* createChildMenu() override {
 		Menu* menu = new Menu;
-		for (int channels = 1; channels <= 16; channels++) {
-			ChannelValueItem* item = new ChannelValueItem;
-			if (channels == 1)
-				item->text = "Monophonic";
-			else
-				item->text = string::f("%d", channels);
-			item->rightText = CHECKMARK(module->outputRouter.numChannels == channels);
-			item->module = module;
-			item->channels = channels;
-			menu->addChild(item);
-		}
+		for (int channels = 1; channels <= BUS_CHANNELS; channels++)
+			addChannels(menu, channels, channels == 1 ? "Monophonic" : string::f("%d", channels));
+
+		//extra buses come out of the modules chained to the right
+		menu->addChild(new MenuSeparator);
+		for (int buses = 2; buses <= MAX_BUSES; buses++)
+			addChannels(menu, buses * BUS_CHANNELS, string::f("%d (%d modules)", buses * BUS_CHANNELS, buses));
 		return menu;
 	}
+
+	void addChannels(Menu* menu, int channels, std::string text) {
+		ChannelValueItem<TModule>* item = new ChannelValueItem<TModule>;
+		item->text = text;
+		item->rightText = CHECKMARK(module->outputRouter.numChannels == channels);
+		item->module = module;
+		item->channels = channels;
+		menu->addChild(item);
+	}
 };
 
 
+template <class TModule>
 struct PolyModeValueItem : MenuItem {
-	Network* module;
+	TModule* module;
 	PolyMode polyMode;
 	void onAction(const event::Action& e) override {
-		module->outputRouter.setPolyMode(polyMode);
+		module->pushCommand(SET_POLY_MODE_COMMAND, polyMode);
+	}
+};
+
+
+template <class TModule>
+struct StealModeValueItem : MenuItem {
+	TModule* module;
+	StealMode stealMode;
+	void onAction(const event::Action& e) override {
+		module->pushCommand(SET_STEAL_MODE_COMMAND, stealMode);
+	}
+};
+
+
+template <class TModule>
+struct CommandValueItem : MenuItem {
+	TModule* module;
+	CommandType command;
+	int value;
+	void onAction(const event::Action& e) override {
+		module->pushCommand(command, value);
 	}
 };
 
 
+template <class TModule>
+struct QuantizeItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		std::vector<std::string> modeNames = {
+			"Off",
+			"Chromatic",
+			"Major",
+			"Natural minor",
+			"Harmonic minor",
+			"Major pentatonic",
+			"Minor pentatonic",
+			"Whole tone"
+		};
+		for (int mode = -1; mode < NUM_MODES; mode++) {
+			CommandValueItem<TModule>* item = new CommandValueItem<TModule>;
+			item->text = modeNames[mode + 1];
+			item->rightText = CHECKMARK(module->outputRouter.quantizeMode == mode);
+			item->module = module;
+			item->command = SET_QUANTIZE_MODE_COMMAND;
+			item->value = mode;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuSeparator);
+		MenuLabel* rootLabel = new MenuLabel;
+		rootLabel->text = "Root";
+		menu->addChild(rootLabel);
+
+		for (int root = 0; root < 12; root++) {
+			CommandValueItem<TModule>* item = new CommandValueItem<TModule>;
+			item->text = NOTE_NAMES[root];
+			item->rightText = CHECKMARK(module->outputRouter.quantizeRoot == root);
+			item->module = module;
+			item->command = SET_QUANTIZE_ROOT_COMMAND;
+			item->value = root;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
+struct GlideItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int time : {0, 5, 20, 50, 100, 250, 500, 1000}) {
+			CommandValueItem<TModule>* item = new CommandValueItem<TModule>;
+			item->text = time ? string::f("%d ms", time) : "Off";
+			item->rightText = CHECKMARK(module->outputRouter.glideTime == time);
+			item->module = module;
+			item->command = SET_GLIDE_TIME_COMMAND;
+			item->value = time;
+			menu->addChild(item);
+		}
+
+		menu->addChild(new MenuSeparator);
+		MenuLabel* curveLabel = new MenuLabel;
+		curveLabel->text = "Curve";
+		menu->addChild(curveLabel);
+
+		std::vector<std::string> curveNames = {
+			"Linear",
+			"Exponential"
+		};
+		for (int i = 0; i < NUM_GLIDE_CURVES; i++) {
+			CommandValueItem<TModule>* item = new CommandValueItem<TModule>;
+			item->text = curveNames[i];
+			item->rightText = CHECKMARK(module->outputRouter.glideCurve == i);
+			item->module = module;
+			item->command = SET_GLIDE_CURVE_COMMAND;
+			item->value = i;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
 struct PolyModeItem : MenuItem {
-	Network* module;
+	TModule* module;
 	Menu* createChildMenu() override {
 		Menu* menu = new Menu;
 		std::vector<std::string> polyModeNames = {
@@ -447,24 +1759,337 @@ struct PolyModeItem : MenuItem {
 		};
 		for (int i = 0; i < NUM_POLY_MODES; i++) {
 			PolyMode polyMode = (PolyMode) i;
-			PolyModeValueItem* item = new PolyModeValueItem;
+			PolyModeValueItem<TModule>* item = new PolyModeValueItem<TModule>;
 			item->text = polyModeNames[i];
 			item->rightText = CHECKMARK(module->outputRouter.polyMode == polyMode);
 			item->module = module;
 			item->polyMode = polyMode;
 			menu->addChild(item);
 		}
+
+		menu->addChild(new MenuSeparator);
+		MenuLabel* stealLabel = new MenuLabel;
+		stealLabel->text = "Voice stealing";
+		menu->addChild(stealLabel);
+
+		std::vector<std::string> stealModeNames = {
+			"Default",
+			"Oldest",
+			"Newest",
+			"Lowest node",
+			"Round robin"
+		};
+		for (int i = 0; i < NUM_STEAL_MODES; i++) {
+			StealMode stealMode = (StealMode) i;
+			StealModeValueItem<TModule>* item = new StealModeValueItem<TModule>;
+			item->text = stealModeNames[i];
+			item->rightText = CHECKMARK(module->outputRouter.stealMode == stealMode);
+			item->module = module;
+			item->stealMode = stealMode;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
+struct LinkTargetItem : MenuItem {
+	TModule* module;
+	int node;
+	int out;
+	int target;
+	int hops;
+	void onAction(const event::Action& e) override {
+		module->pushCommand(SET_LINK_HOPS_COMMAND, hops, node, out);
+		module->pushCommand(SET_LINK_COMMAND, target, node, out);
+	}
+};
+
+
+inline std::string linkTargetName(int target, int hops){
+	if (target < 0)
+		return "None";
+	if (hops < 0)
+		return string::f("Left node %d", target+1);
+	if (hops > 0)
+		return string::f("Right node %d", target+1);
+	return string::f("Node %d", target+1);
+}
+
+
+template <class TModule>
+struct LinkOutputItem : MenuItem {
+	TModule* module;
+	int node;
+	int out;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int target = -1; target < TModule::NUM_NODES; target++)
+			addTarget(menu, target, 0);
+
+		//nodes of chained neighbours
+		if (module->leftNodes > 0) {
+			menu->addChild(new MenuSeparator);
+			for (int target = 0; target < module->leftNodes; target++)
+				addTarget(menu, target, -1);
+		}
+		if (module->rightNodes > 0) {
+			menu->addChild(new MenuSeparator);
+			for (int target = 0; target < module->rightNodes; target++)
+				addTarget(menu, target, 1);
+		}
+		return menu;
+	}
+
+	void addTarget(Menu* menu, int target, int hops) {
+		Node* n = &module->nodes[node];
+		LinkTargetItem<TModule>* item = new LinkTargetItem<TModule>;
+		item->text = linkTargetName(target, hops);
+		item->rightText = CHECKMARK(n->links[out] == target && (target < 0 || n->linkHops[out] == hops));
+		item->module = module;
+		item->node = node;
+		item->out = out;
+		item->target = target;
+		item->hops = hops;
+		menu->addChild(item);
+	}
+};
+
+
+template <class TModule>
+struct LinkNodeItem : MenuItem {
+	TModule* module;
+	int node;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int out = 0; out < NODE_NUM_OUTS; out++) {
+			int target = module->nodes[node].links[out];
+			LinkOutputItem<TModule>* item = new LinkOutputItem<TModule>;
+			item->text = string::f("Output %d", out+1);
+			item->rightText = (target >= 0 ? linkTargetName(target, module->nodes[node].linkHops[out]) : "") + "  " + RIGHT_ARROW;
+			item->module = module;
+			item->node = node;
+			item->out = out;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
+struct LinksItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int node = 0; node < TModule::NUM_NODES; node++) {
+			LinkNodeItem<TModule>* item = new LinkNodeItem<TModule>;
+			item->text = string::f("Node %d", node+1);
+			item->rightText = RIGHT_ARROW;
+			item->module = module;
+			item->node = node;
+			menu->addChild(item);
+		}
 		return menu;
 	}
 };
 
 
-struct NetworkWidget : ModuleWidget {
-    LightWidget *knobLights[4*4];
+template <class TModule>
+struct SceneValueItem : MenuItem {
+	TModule* module;
+	CommandType command;
+	int scene;
+	void onAction(const event::Action& e) override {
+		module->pushCommand(command, scene);
+	}
+};
+
 
-	NetworkWidget(Network* module) {
+template <class TModule>
+struct SceneItem : MenuItem {
+	TModule* module;
+	CommandType command;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int scene = 0; scene < NUM_SCENES; scene++) {
+			SceneValueItem<TModule>* item = new SceneValueItem<TModule>;
+			item->text = string::f("Scene %d", scene+1);
+			if (module->scenes[scene].saved)
+				item->text += " *";
+			item->rightText = CHECKMARK(module->currentScene == scene);
+			item->module = module;
+			item->command = command;
+			item->scene = scene;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+//cables from a module back into itself
+inline std::vector<RenderCable> getSelfCables(Module* module) {
+	std::vector<RenderCable> cables;
+	for (Widget* w : APP->scene->rack->cableContainer->children) {
+		CableWidget* cw = dynamic_cast<CableWidget*>(w);
+		if (cw && cw->isComplete() && cw->cable->outputModule == module && cw->cable->inputModule == module)
+			cables.push_back({cw->cable->outputId, cw->cable->inputId});
+	}
+	return cables;
+}
+
+
+template <class TModule>
+struct RenderStepsItem : MenuItem {
+	TModule* module;
+	int steps;
+	void onAction(const event::Action& e) override {
+		std::vector<RenderCable> cables = getSelfCables(module);
+
+		char* pathC = osdialog_file(OSDIALOG_SAVE, NULL, "sequence.csv", NULL);
+		if (!pathC)
+			return;
+		std::string path = pathC;
+		std::free(pathC);
+
+		module->renderSequence(path, steps, cables);
+	}
+};
+
+
+template <class TModule>
+struct RenderItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		if (module->working)
+			return nullptr;
+		Menu* menu = new Menu;
+		for (int steps : {16, 64, 256, 1024, 4096}) {
+			RenderStepsItem<TModule>* item = new RenderStepsItem<TModule>;
+			item->text = string::f("%d steps", steps);
+			item->module = module;
+			item->steps = steps;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
+struct AnalyseItem : MenuItem {
+	TModule* module;
+	void onAction(const event::Action& e) override {
+		if (not module->working)
+			module->compileSequence(getSelfCables(module));
+	}
+};
+
+
+template <class TModule>
+struct SeekValueItem : MenuItem {
+	TModule* module;
+	int step;
+	void onAction(const event::Action& e) override {
+		module->seekSequence(step);
+	}
+};
+
+
+//step number typed in, for sequences too long to list
+template <class TModule>
+struct SeekField : TextField {
+	TModule* module;
+	void onAction(const event::Action& e) override {
+		module->seekSequence(std::atoi(text.c_str()) - 1);
+		MenuOverlay* overlay = getAncestorOfType<MenuOverlay>();
+		if (overlay)
+			overlay->requestDelete();
+	}
+};
+
+
+template <class TModule>
+struct SeekItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		int total = module->sequence.states.size();
+		if (total > MAX_SEEK_MENU_STEPS) {
+			MenuLabel* label = new MenuLabel;
+			label->text = string::f("Step 1 to %d, enter to jump", total);
+			menu->addChild(label);
+
+			SeekField<TModule>* field = new SeekField<TModule>;
+			field->placeholder = "Step";
+			field->box.size.x = 100;
+			field->module = module;
+			menu->addChild(field);
+		}
+		int steps = std::min(total, MAX_SEEK_MENU_STEPS);
+		for (int step = 0; step < steps; step++) {
+			SeekValueItem<TModule>* item = new SeekValueItem<TModule>;
+			item->text = string::f("Step %d", step+1);
+			if (step == module->sequence.intro && module->sequence.intro > 0)
+				item->rightText = "loop";
+			item->module = module;
+			item->step = step;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
+
+template <class TModule>
+struct SequenceItem : MenuItem {
+	TModule* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		module->takeSequence();
+
+		AnalyseItem<TModule>* analyseItem = new AnalyseItem<TModule>;
+		analyseItem->text = "Analyse from reset";
+		analyseItem->rightText = module->working ? "busy" : "";
+		analyseItem->disabled = module->working;
+		analyseItem->module = module;
+		menu->addChild(analyseItem);
+
+		if (not module->sequence.compiled)
+			return menu;
+
+		MenuLabel* lengthLabel = new MenuLabel;
+		if (module->sequence.length == 0)
+			lengthLabel->text = string::f("Longer than %d steps", MAX_SEQUENCE_STEPS);
+		else if (module->sequence.intro > 0)
+			lengthLabel->text = string::f("Length: %d steps, after %d intro steps", module->sequence.length, module->sequence.intro);
+		else
+			lengthLabel->text = string::f("Length: %d steps", module->sequence.length);
+		menu->addChild(lengthLabel);
+
+		SeekItem<TModule>* seekItem = new SeekItem<TModule>;
+		seekItem->text = "Jump to step";
+		seekItem->rightText = RIGHT_ARROW;
+		seekItem->module = module;
+		menu->addChild(seekItem);
+		return menu;
+	}
+};
+
+
+template <int ROWS, int COLS>
+struct TNetworkWidget : ModuleWidget {
+	typedef TNetwork<ROWS, COLS> TModule;
+
+    LightWidget *knobLights[TModule::NUM_NODES];
+
+	TNetworkWidget(TModule* module) {
 		setModule(module);
-		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/Network.svg")));
+		//the original 4x4 keeps its old panel name
+		std::string panel = (ROWS == 4 && COLS == 4) ? "res/Network.svg" : string::f("res/Network%dx%d.svg", ROWS, COLS);
+		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, panel)));
 
 		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, 0)));
 		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, 0)));
@@ -480,13 +2105,13 @@ struct NetworkWidget : ModuleWidget {
 		int bypassesDone = 0;
 		float angleOffset = 0;// PI/6;
 
-		for(int i = 0; i < 4; i++){
+		for(int i = 0; i < ROWS; i++){
 			cy = (128.52-(border*2))/3*i;
 			cy *= 0.75;
 
 			cy += border;
 
-			for(int j = 0; j < 4; j++){
+			for(int j = 0; j < COLS; j++){
 				cx = (121.92-(border*2))/3*(j + (i % 2 ? 0.5 : 0));
 				cx += border;
 				
@@ -499,22 +2124,22 @@ struct NetworkWidget : ModuleWidget {
 					y = sin(angle)*dist;
 
 					if( k < NODE_NUM_INS )
-                        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(cx+x, cy+y)), module, Network::TRIG_INPUT+insDone++));
+                        addInput(createInputCentered<PJ301MPort>(mm2px(Vec(cx+x, cy+y)), module, TModule::TRIG_INPUT+insDone++));
                     else
-                        addOutput(createOutputCentered<RoundJackOut>(mm2px(Vec(cx+x, cy+y)), module, Network::TRIG_OUTPUT+outsDone++));
+                        addOutput(createOutputCentered<RoundJackOut>(mm2px(Vec(cx+x, cy+y)), module, TModule::TRIG_OUTPUT+outsDone++));
 
                 }						
 				
-				knobLights[nodesDone] = createLightCentered<KnobLight>(mm2px(Vec(cx,cy)), module, Network::TRIG_LIGHT + nodesDone);
+				knobLights[nodesDone] = createLightCentered<KnobLight>(mm2px(Vec(cx,cy)), module, TModule::TRIG_LIGHT + nodesDone);
 				addChild(knobLights[nodesDone]);			
  			
-				addParam(createParamCentered<KnobTransparent>(mm2px(Vec(cx,cy)), module, Network::VAL_PARAM+nodesDone));
+				addParam(createParamCentered<KnobTransparent>(mm2px(Vec(cx,cy)), module, TModule::VAL_PARAM+nodesDone));
 				
 				if( j == 0 && i % 2 == 0){
 					x = cos(PI*2/6)*dist*2;
 					y = sin(PI*2/6)*dist*2;
-					addChild(createLightCentered<KnobLight>(mm2px(Vec(cx-x,cy+y)), module, Network::BYPASS_LIGHT+bypassesDone));
-					addParam(createParamCentered<PushButtonLargeTransparent>(mm2px(Vec(cx-x,cy+y)), module, Network::BYPASS_PARAM+bypassesDone));
+					addChild(createLightCentered<KnobLight>(mm2px(Vec(cx-x,cy+y)), module, TModule::BYPASS_LIGHT+bypassesDone));
+					addParam(createParamCentered<PushButtonLargeTransparent>(mm2px(Vec(cx-x,cy+y)), module, TModule::BYPASS_PARAM+bypassesDone));
 					bypassesDone++;
 				}
 				nodesDone++;
@@ -528,27 +2153,32 @@ struct NetworkWidget : ModuleWidget {
 			x = cos(angle)*dist;
 			y = sin(angle)*dist;
 
-			addInput(createInputCentered<PJ301MPort>(mm2px(Vec(cx+x, cy+y)), module, Network::RESET_INPUT+k));
+			addInput(createInputCentered<PJ301MPort>(mm2px(Vec(cx+x, cy+y)), module, TModule::RESET_INPUT+k));
 		}
-		addParam(createParamCentered<PushButtonMomentaryLarge>(mm2px(Vec(cx, cy)), module, Network::RESET_PARAM));
+		addParam(createParamCentered<PushButtonMomentaryLarge>(mm2px(Vec(cx, cy)), module, TModule::RESET_PARAM));
 		
+		//the outputs and scene inputs keep to the right edge of the panel
+		float right = box.size.x / mm2px(Vec(1, 1)).x;
 		cy += 0.5f;
-		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(115, cy-5)), module, Network::CV_OUTPUT));
-		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(115, cy+5)), module, Network::GATE_OUTPUT));
-		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(106, cy)), module, Network::RETRIG_OUTPUT));
+		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(right - 17.08f, cy-5)), module, TModule::CV_OUTPUT));
+		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(right - 17.08f, cy+5)), module, TModule::GATE_OUTPUT));
+		addOutput(createOutputCentered<RoundJackOutRinged>(mm2px(Vec(right - 26.08f, cy)), module, TModule::RETRIG_OUTPUT));
+
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(right - 48.08f, cy)), module, TModule::SCENE_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(right - 38.08f, cy)), module, TModule::SCENE_TRIG_INPUT));
 	
 		cy -= 4.f;
-		addParam(createParamCentered<RockerSwitchVertical>(mm2px(Vec(43.463, cy)), module, Network::BIPOLAR_PARAM));
-		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(47, cy+8.1)), module, Network::ATTENUVERSION_INPUT));
-		addParam(createParamCentered<KnobTransparentDotted>(mm2px(Vec(53, cy)), module, Network::ATTENUVERSION_PARAM));
+		addParam(createParamCentered<RockerSwitchVertical>(mm2px(Vec(43.463, cy)), module, TModule::BIPOLAR_PARAM));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(47, cy+8.1)), module, TModule::ATTENUVERSION_INPUT));
+		addParam(createParamCentered<KnobTransparentDotted>(mm2px(Vec(53, cy)), module, TModule::ATTENUVERSION_PARAM));
 		
 	}
 
 	void step() override {
-		Network *module = dynamic_cast<Network*>(this->module);
+		TModule *module = dynamic_cast<TModule*>(this->module);
 
 		if (module) {
-			for(int node = 0; node < 4*4; node++){
+			for(int node = 0; node < TModule::NUM_NODES; node++){
 				if(module->nodes[node].isBypass()){
 					knobLights[node]->bgColor = nvgRGB(0x10,0x00,0x00); 	
 				}
@@ -561,26 +2191,73 @@ struct NetworkWidget : ModuleWidget {
 	}
 
 	void appendContextMenu(Menu* menu) override {
-		Network* module = dynamic_cast<Network*>(this->module);
+		TModule* module = dynamic_cast<TModule*>(this->module);
 
 		menu->addChild(new MenuEntry);
 		menu->addChild(new MenuSeparator());
 
-		ChannelItem* channelItem = new ChannelItem;
+		ChannelItem<TModule>* channelItem = new ChannelItem<TModule>;
 		channelItem->text = "Polyphony channels";
 		channelItem->rightText = string::f("%d", module->outputRouter.numChannels) + "  " + RIGHT_ARROW;
 		channelItem->module = module;
 		menu->addChild(channelItem);
 
-		PolyModeItem* polyModeItem = new PolyModeItem;
+		PolyModeItem<TModule>* polyModeItem = new PolyModeItem<TModule>;
 		polyModeItem->text = "Polyphony mode";
 		polyModeItem->rightText = RIGHT_ARROW;
 		polyModeItem->module = module;
 		menu->addChild(polyModeItem);
 
+		QuantizeItem<TModule>* quantizeItem = new QuantizeItem<TModule>;
+		quantizeItem->text = "Quantize CV";
+		quantizeItem->rightText = RIGHT_ARROW;
+		quantizeItem->module = module;
+		menu->addChild(quantizeItem);
+
+		GlideItem<TModule>* glideItem = new GlideItem<TModule>;
+		glideItem->text = "Glide";
+		glideItem->rightText = RIGHT_ARROW;
+		glideItem->module = module;
+		menu->addChild(glideItem);
+
+		LinksItem<TModule>* linksItem = new LinksItem<TModule>;
+		linksItem->text = "Internal links";
+		linksItem->rightText = RIGHT_ARROW;
+		linksItem->module = module;
+		menu->addChild(linksItem);
+
+		SceneItem<TModule>* saveSceneItem = new SceneItem<TModule>;
+		saveSceneItem->text = "Save scene";
+		saveSceneItem->rightText = RIGHT_ARROW;
+		saveSceneItem->module = module;
+		saveSceneItem->command = SAVE_SCENE_COMMAND;
+		menu->addChild(saveSceneItem);
+
+		SceneItem<TModule>* loadSceneItem = new SceneItem<TModule>;
+		loadSceneItem->text = "Load scene";
+		loadSceneItem->rightText = RIGHT_ARROW;
+		loadSceneItem->module = module;
+		loadSceneItem->command = LOAD_SCENE_COMMAND;
+		menu->addChild(loadSceneItem);
+
+		RenderItem<TModule>* renderItem = new RenderItem<TModule>;
+		renderItem->text = "Render sequence to CSV";
+		renderItem->rightText = module->working ? "busy" : RIGHT_ARROW;
+		renderItem->disabled = module->working;
+		renderItem->module = module;
+		menu->addChild(renderItem);
+
+		SequenceItem<TModule>* sequenceItem = new SequenceItem<TModule>;
+		sequenceItem->text = "Sequence length";
+		sequenceItem->rightText = RIGHT_ARROW;
+		sequenceItem->module = module;
+		menu->addChild(sequenceItem);
+
 	}
 
 
 };
 
-Model* modelNetwork = createModel<Network, NetworkWidget>("Network");
+Model* modelNetwork4x2 = createModel<Network4x2, TNetworkWidget<4, 2>>("Network4x2");
+Model* modelNetwork = createModel<Network, TNetworkWidget<4, 4>>("Network");
+Model* modelNetwork4x8 = createModel<Network4x8, TNetworkWidget<4, 8>>("Network4x8");
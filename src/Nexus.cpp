@@ -5,6 +5,34 @@
 
 #define NUM_STAGES 6
 
+//seek input and step output scale, 6 stages of 99 reps fit in 6V
+#define STEP_VOLTAGE 0.01f
+
+//most Nexus modules one chain schedules its resets across
+const int MAX_CHAIN = 16;
+
+//expander message between neighbouring Nexus modules, double buffered by the engine.
+//a chain's stages run left to right, and the chain resets as one
+struct NexusMessage{
+	//rightwards: gates leaving the sender's last stage, normalled to the receiver's first
+	int numChannels;
+	uint16_t passMask;
+	float gates[16];
+	//rightwards: channels to reset once resetWait more samples have passed
+	uint16_t resetMask;
+	int resetWait;
+	//leftwards: modules from the sender to the end of the chain
+	int chainLength;
+	//leftwards: the sender's first stage takes the chain's gates
+	bool accepting;
+	//leftwards: resets on their way to the chain's first module, which schedules them for everyone
+	uint16_t resetRequest;
+};
+
+inline bool isNexus(Module* module){
+	return module && module->model == modelNexus;
+}
+
 struct Stage{
 	int counter = 0;
 	Param* knob;
@@ -12,14 +40,30 @@ struct Stage{
     Input* input;
     Output* output;
 	Output* next;
-	dsp::SchmittTrigger inputTriggers[16];
+	TriggerBank inputTriggers;
 	dsp::Timer suppressTrigsTimer;
 	
 	bool inConnected = false;
 	bool nextConnected = false;
 
+	//resolved normalling: input the stage's gates come from,
+	//and the one its channel count comes from. nullptr for none
+	Input* source = nullptr;
+	Input* channelSource = nullptr;
+	//channels of channelSource that reach this stage, in independent channels mode
+	uint16_t passMask = 0;
+
 	bool done = false;
 	float lightBrightness = 0.f;
+
+	//outputs written since the last reset, resets only clear those
+	bool outputDirty = false;
+	bool nextDirty = false;
+
+	//independent channels mode: a count, done flag and trig suppression per channel
+	simd::float_4 counters[4] = {};
+	simd::float_4 suppressTimes[4] = {};
+	uint16_t doneMask = 0;
 	
 	void init(Param* _knob, Light* _light, Input* _input, Output* _output, Output* _next){
 		knob = _knob;
@@ -34,12 +78,98 @@ struct Stage{
 		counter = 0;
 		done = false;
 		lightBrightness = 0.f;
-		for(int i = 0; i < 16; i++){
-			output->setVoltage(0.f,i);
-			next->setVoltage(0.f,i);
-			inputTriggers[i].process(0.f);
+		for(int c = 0; c < 16; c += 4){
+			if(outputDirty) output->setVoltageSimd(simd::float_4::zero(), c);
+			if(nextDirty) next->setVoltageSimd(simd::float_4::zero(), c);
+			counters[c/4] = simd::float_4::zero();
+			suppressTimes[c/4] = simd::float_4::zero();
+		}
+		outputDirty = false;
+		nextDirty = false;
+		doneMask = 0;
+		inputTriggers.reset();
+	}
+
+	//independent channels mode, restart the channels in mask
+	void resetChannels(uint16_t mask){
+		for(int c = 0; c < 16; c += 4){
+			simd::float_4 m = laneMask(mask >> c);
+			if(outputDirty) output->setVoltageSimd(simd::ifelse(m, 0.f, output->getVoltageSimd<simd::float_4>(c)), c);
+			if(nextDirty) next->setVoltageSimd(simd::ifelse(m, 0.f, next->getVoltageSimd<simd::float_4>(c)), c);
+			counters[c/4] = simd::ifelse(m, 0.f, counters[c/4]);
+			suppressTimes[c/4] = simd::ifelse(m, 0.f, suppressTimes[c/4]);
+		}
+		doneMask &= ~mask;
+		inputTriggers.reset(mask);
+	}
+
+	//jump straight to a position: done, or counter gates into the stage
+	void seek(bool _done, int _counter){
+		reset();
+		done = _done;
+		counter = _counter;
+	}
+
+	void seekChannels(uint16_t mask, bool _done, int _counter){
+		resetChannels(mask);
+		if(_done)
+			doneMask |= mask;
+		for(int c = 0; c < 16; c += 4)
+			counters[c/4] = simd::ifelse(laneMask(mask >> c), (float) _counter, counters[c/4]);
+	}
+
+	//independent channels mode: each channel counts its own gates and moves on by itself.
+	//resetSettled is false in the 1ms after a reset of every channel, when trigs are ignored like in shared mode
+	void processChannels(float dt, int numChannels, bool resetSettled){
+		int blocks = (numChannels + 3) / 4;
+		uint16_t rising = inputTriggers.process(channelSource, passMask);
+		if(not resetSettled)
+			rising = 0;
+
+		//ignore trigs that are too close together
+		uint16_t allowed = 0;
+		for(int b = 0; b < blocks; b++){
+			suppressTimes[b] += dt;
+			allowed |= simd::movemask(suppressTimes[b] > 1e-3f) << (b * 4);
+		}
+		rising &= allowed;
+		uint16_t counting = rising & ~doneMask;
+
+		float reps = knob->getValue();
+		uint16_t finished = 0;
+		for(int c = 0; c < blocks * 4; c += 4){
+			int b = c / 4;
+			suppressTimes[b] = simd::ifelse(laneMask(rising >> c), 0.f, suppressTimes[b]);
+			counters[b] += simd::ifelse(laneMask(counting >> c), 1.f, 0.f);
+			finished |= simd::movemask(counters[b] > reps) << c;
+			counters[b] = simd::ifelse(counters[b] > reps, 0.f, counters[b]);
 		}
+		doneMask |= finished;
+
+		//unfinished channels go to the trig output, finished ones to next
+		bool nextConnected = next->isConnected();
+		outputDirty = true;
+		nextDirty |= nextConnected;
+		for(int c = 0; c < blocks * 4; c += 4){
+			simd::float_4 v = channelSource ? channelSource->getVoltageSimd<simd::float_4>(c) : simd::float_4::zero();
+			v = simd::ifelse(laneMask(passMask >> c), v, 0.f);
+			simd::float_4 d = laneMask(doneMask >> c);
+			output->setVoltageSimd(simd::ifelse(d, 0.f, v), c);
+			if(nextConnected)
+				next->setVoltageSimd(simd::ifelse(d, v, 0.f), c);
+		}
+
+		lightBrightness = (inputTriggers.highMask & ~doneMask) ? 1.f : 0.f;
+	}
 
+	//pass the stage's gates through to an output, 4 channels at a time
+	void forward(Output* out, int numChannels){
+		if(out == output) outputDirty = true;
+		else nextDirty = true;
+		for(int c = 0; c < numChannels; c += 4){
+			simd::float_4 v = source ? source->getVoltageSimd<simd::float_4>(c) : simd::float_4::zero();
+			out->setVoltageSimd(v, c);
+		}
 	}
 
 };
@@ -55,11 +185,13 @@ struct Nexus : Module {
 	enum InputIds {
 		ENUMS(TRIG_INPUT, NUM_STAGES),
         ENUMS(RESET_INPUT, 2),
+		SEEK_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
 		ENUMS(TRIG_OUTPUT, NUM_STAGES),
 		ENUMS(NEXT_OUTPUT, NUM_STAGES),
+		STEP_OUTPUT,
 		NUM_OUTPUTS
 	};
 	enum LightIds {
@@ -67,12 +199,38 @@ struct Nexus : Module {
 		NUM_LIGHTS
 	};
 
-    dsp::SchmittTrigger resetTrigger[2][16];
+    TriggerBank resetTriggers[2];
 	dsp::BooleanTrigger resetBtnTrigger;
 	Stage stages[NUM_STAGES];	
 
 	dsp::Timer resetTimer;
 
+	//set from the ui, every poly channel counts through the stages on its own
+	bool independentChannels = false;
+	bool channelMode = false;
+
+	//position index. stage 1 and the stages it feeds through normalling form the run,
+	//stage s of the run starts counting once boundaries[s] gates went into stage 1
+	int boundaries[NUM_STAGES + 1] = {};
+	int runLength = 1;
+	//last step read from the seek input, per channel. -1 while unpatched
+	int seekSteps[16];
+
+	//expander chaining, see NexusMessage
+	NexusMessage leftMessages[2] = {};
+	NexusMessage rightMessages[2] = {};
+	//stage 1's normal, the gates the left module passes on
+	Input chainInput;
+	uint16_t chainMask = 0;
+	int chainLength = 1;
+	//resets scheduled for the whole chain, by sample
+	uint16_t scheduledResets[MAX_CHAIN] = {};
+	int schedulePos = 0;
+	//resets asked for this sample
+	uint16_t resetRequest = 0;
+	//channels whose wrap around reset is on its way through the chain
+	uint16_t wrapping = 0;
+
     Nexus() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(RESET_PARAM, 0, 1, 0, "Reset");		 
@@ -86,33 +244,47 @@ struct Nexus : Module {
 				&outputs[NEXT_OUTPUT+stage]
 			);
 		}	
+		for(int c = 0; c < 16; c++)
+			seekSteps[c] = -1;
+
+		leftExpander.producerMessage = &leftMessages[0];
+		leftExpander.consumerMessage = &leftMessages[1];
+		rightExpander.producerMessage = &rightMessages[0];
+		rightExpander.consumerMessage = &rightMessages[1];
     }
 
-	float getInput(int stageNum, int ch){
+	//an unpatched input is normalled to the previous stage's input,
+	//gates only pass once that stage is done and its next output is free.
+	//call in stage order, it builds on the previous stage's result
+	void resolveSource(int stageNum){
 		Stage* s = &stages[stageNum];
 
-		if(s->input->isConnected())
-			return s->input->getVoltage(ch);
-		else if(stageNum > 0 && stages[stageNum-1].done && not stages[stageNum-1].next->isConnected())
-			return getInput(stageNum-1, ch);
-		else return 0;
+		if(s->input->isConnected()){
+			s->source = s->input;
+			s->channelSource = s->input;
+			s->passMask = 0xFFFF;
+		}
+		else if(stageNum == 0 && chainInput.isConnected()){
+			s->source = chainMask ? &chainInput : nullptr;
+			s->channelSource = &chainInput;
+			s->passMask = chainMask;
+		}
+		else if(stageNum > 0 && not stages[stageNum-1].next->isConnected()){
+			Stage* prev = &stages[stageNum-1];
+			s->source = prev->done ? prev->source : nullptr;
+			s->channelSource = prev->channelSource;
+			s->passMask = prev->passMask & prev->doneMask;
+		}
+		else{
+			s->source = nullptr;
+			s->channelSource = nullptr;
+			s->passMask = 0;
+		}
 	}
 
 	int getNumChannels(int stageNum){
-		Stage* s = &stages[stageNum];
-
-		if(s->input->isConnected())
-			return s->input->getChannels();
-		else if(stageNum > 0 && not stages[stageNum-1].next->isConnected())
-			return getNumChannels(stageNum-1);
-		else return 0;
-	}
-
-	bool allTrigsLow(int stageNum){
-		for (int ch = 0; ch < 16; ch++)
-			if(stages[stageNum].inputTriggers[ch].isHigh()) 
-				return false;
-		return true;
+		Input* source = stages[stageNum].channelSource;
+		return source ? source->getChannels() : 0;
 	}
 
 	void reset(){
@@ -121,10 +293,162 @@ struct Nexus : Module {
 			stages[stage].suppressTrigsTimer.time = 1;
 		}
 		resetTimer.reset();
+		wrapping = 0;
+	}
+
+	void resetChannels(uint16_t mask){
+		for(int stage = 0; stage < NUM_STAGES; stage++)
+			stages[stage].resetChannels(mask);
+		wrapping &= ~mask;
+	}
+
+	//reset now, or once wait more samples have passed
+	void scheduleReset(uint16_t mask, int wait){
+		if(wait <= 0)
+			applyReset(mask);
+		else
+			scheduledResets[(schedulePos + std::min(wait, MAX_CHAIN - 1)) % MAX_CHAIN] |= mask;
+	}
+
+	void applyReset(uint16_t mask){
+		if(not channelMode || mask == 0xFFFF)
+			reset();
+		else
+			resetChannels(mask);
+	}
+
+	//requests travel left to the chain's first module. it schedules them
+	//as far ahead as the chain is long, and the schedule travels right,
+	//so every module resets on the same sample
+	void processResets(NexusMessage* fromLeft, NexusMessage* toLeft, NexusMessage* toRight){
+		schedulePos = (schedulePos + 1) % MAX_CHAIN;
+		uint16_t due = scheduledResets[schedulePos];
+		scheduledResets[schedulePos] = 0;
+		if(due)
+			applyReset(due);
+
+		uint16_t mask = 0;
+		int wait = 0;
+		if(fromLeft){
+			toLeft->resetRequest = resetRequest;
+			mask = fromLeft->resetMask;
+			wait = fromLeft->resetWait;
+		}
+		else{
+			mask = resetRequest;
+			wait = chainLength - 1;
+		}
+		resetRequest = 0;
+
+		if(mask)
+			scheduleReset(mask, wait);
+		if(toRight){
+			toRight->resetMask = mask;
+			toRight->resetWait = wait - 1;
+		}
+	}
+
+	//stage 1's normal, an Input of our own so the stages can read it like a cable's
+	void receiveGates(NexusMessage* message){
+		chainInput.channels = message ? message->numChannels : 0;
+		chainMask = message ? message->passMask : 0;
+		//every lane, the triggers read whole blocks of 4 past the last channel
+		for(int c = 0; c < 16; c++)
+			chainInput.setVoltage(message ? message->gates[c] : 0.f, c);
+	}
+
+	//the last stage's finished gates go on to the next module's first stage
+	void sendGates(NexusMessage* message, bool pass){
+		Stage* s = &stages[NUM_STAGES-1];
+		pass = pass && not s->next->isConnected();
+		Input* in = channelMode ? s->channelSource : s->source;
+		message->numChannels = getNumChannels(NUM_STAGES-1);
+		if(channelMode)
+			message->passMask = pass ? s->passMask & s->doneMask : 0;
+		else
+			message->passMask = pass && s->done ? 0xFFFF : 0;
+		for(int c = 0; c < 16; c++)
+			message->gates[c] = in && c < message->numChannels && (message->passMask >> c & 1) ? in->getVoltage(c) : 0.f;
+	}
+
+	void updateBoundaries(){
+		runLength = 1;
+		while(runLength < NUM_STAGES && not stages[runLength].input->isConnected() && not stages[runLength-1].next->isConnected())
+			runLength++;
+		for(int stage = 0; stage < runLength; stage++)
+			boundaries[stage+1] = boundaries[stage] + (int) stages[stage].knob->getValue();
+	}
+
+	//jump to the state the run is in after step gates. 
+	//mask selects the channels in independent channels mode
+	void seek(int step, uint16_t mask){
+		step = clamp(step, 0, boundaries[runLength]);
+		//every stage of the run watches the same gates, a gate held through the seek must not count again
+		TriggerBank clock = stages[0].inputTriggers;
+		for(int stage = 0; stage < runLength; stage++){
+			Stage* s = &stages[stage];
+			bool done = step > boundaries[stage+1];
+			int counter = done ? 0 : std::max(step - boundaries[stage], 0);
+			if(channelMode){
+				s->seekChannels(mask, done, counter);
+				s->inputTriggers.copy(clock, mask);
+			}
+			else{
+				s->seek(done, counter);
+				s->inputTriggers.copy(clock);
+			}
+		}
+	}
+
+	//position index of the run, the number of gates it took since the start
+	void processStepOutput(){
+		Output* out = &outputs[STEP_OUTPUT];
+		if(channelMode){
+			int numChannels = getNumChannels(0);
+			out->setChannels(numChannels);
+			for(int c = 0; c < numChannels; c += 4){
+				simd::float_4 step = simd::float_4::zero();
+				for(int stage = 0; stage < runLength; stage++){
+					Stage* s = &stages[stage];
+					float reps = boundaries[stage+1] - boundaries[stage];
+					step += simd::ifelse(laneMask(s->doneMask >> c), reps, s->counters[c/4]);
+				}
+				out->setVoltageSimd(step * STEP_VOLTAGE, c);
+			}
+			return;
+		}
+
+		int step = boundaries[runLength];
+		for(int stage = 0; stage < runLength; stage++){
+			if(not stages[stage].done){
+				step = boundaries[stage] + stages[stage].counter;
+				break;
+			}
+		}
+		out->setChannels(1);
+		out->setVoltage(step * STEP_VOLTAGE);
 	}
 
     void process(const ProcessArgs& args) override {
 
+		if(independentChannels != channelMode){
+			channelMode = independentChannels;
+			reset();
+		}
+
+		//what the neighbouring Nexus modules sent last sample
+		NexusMessage* fromLeft = isNexus(leftExpander.module) ? (NexusMessage*) leftExpander.consumerMessage : nullptr;
+		NexusMessage* fromRight = isNexus(rightExpander.module) ? (NexusMessage*) rightExpander.consumerMessage : nullptr;
+		NexusMessage* toLeft = fromLeft ? (NexusMessage*) leftExpander.module->rightExpander.producerMessage : nullptr;
+		NexusMessage* toRight = fromRight ? (NexusMessage*) rightExpander.module->leftExpander.producerMessage : nullptr;
+		chainLength = fromRight ? std::min(fromRight->chainLength + 1, MAX_CHAIN) : 1;
+		//the last stage carries on into the right module instead of wrapping around
+		bool passRight = fromRight && fromRight->accepting;
+		receiveGates(fromLeft);
+
+		//trigs in the 1ms after a reset are ignored, so a clock sent with the reset doesn't count
+		bool resetSettled = resetTimer.process(args.sampleTime) > 1e-3f;
+
 		for(int stage = 0; stage < NUM_STAGES; stage++){
 			
 			Stage* s = &stages[stage];	
@@ -132,20 +456,35 @@ struct Nexus : Module {
 			//process input			
 			bool doTrigger = false;
 
+			resolveSource(stage);
+
 			int numChannels = getNumChannels(stage);
 			s->output->setChannels(numChannels);
 			s->next->setChannels(numChannels);
+
+			if(channelMode){
+				s->processChannels(args.sampleTime, numChannels, resetSettled);
+				//"next" not connected on the last stage, finished channels start over
+				if(stage == NUM_STAGES - 1 && not s->next->isConnected() && not passRight){
+					resetRequest |= s->doneMask & ~wrapping;
+					wrapping |= s->doneMask;
+				}
+				s->light->setSmoothBrightness(s->lightBrightness, args.sampleTime);
+				continue;
+			}
 			
 			s->suppressTrigsTimer.process(args.sampleTime);
 
-			if(resetTimer.process(args.sampleTime) > 1e-3f && s->suppressTrigsTimer.time > 1e-3f){
+			if(not resetSettled){
+				//keep the triggers following the input, so a gate that rose with the reset
+				//isn't taken as a new one when the time's up
+				s->inputTriggers.process(s->source);
+			}
+			else if(s->suppressTrigsTimer.time > 1e-3f){
 
 
-				for (int ch = 0; ch < 16; ch++){		
-					float val = getInput(stage, ch);		
-					val = rescale(val, 0.1f, 2.f, 0.f, 1.f);//obey voltage stadards for triggers
-					if(s->inputTriggers[ch].process(val)) doTrigger = true;
-				}
+				//the source's channels always match numChannels
+				if(s->inputTriggers.process(s->source)) doTrigger = true;
 			
 				if(doTrigger) s->suppressTrigsTimer.reset();
 
@@ -160,23 +499,23 @@ struct Nexus : Module {
 				
 				if(not s->done){
 					//still going. to output.		
-					for (int ch = 0; ch < 16; ch++)
-						s->output->setVoltage(getInput(stage, ch),ch);
+					s->forward(s->output, numChannels);
 					
-					float v = allTrigsLow(stage) ? 0.f : 10.f;	
+					float v = s->inputTriggers.anyHigh() ? 10.f : 0.f;	
 					s->lightBrightness = v/10.f;
 				}
 				else{
 					//done. 
 					if(s->next->isConnected()){
 						//"next" output connected, forward there.
-						for (int ch = 0; ch < 16; ch++)
-							s->next->setVoltage(getInput(stage, ch),ch);
+						s->forward(s->next, numChannels);
 					}
 					else{
 						//"next" not connected. fall back to "normal" routing
-						if(stage == NUM_STAGES -1)
-							reset();
+						if(stage == NUM_STAGES -1 && not passRight && not wrapping){
+							resetRequest = 0xFFFF;
+							wrapping = 0xFFFF;
+						}
 					}
 				}
 			}
@@ -186,20 +525,75 @@ struct Nexus : Module {
 
 		//important that this happens last
 		if(resetBtnTrigger.process(params[RESET_PARAM].getValue())){
-			reset();
+			resetRequest = 0xFFFF;
 		}
 
 		for(int in = 0; in < 2; in++){
-			for (int ch = 0; ch < 16; ch++){
-				float val = inputs[RESET_INPUT+in].getVoltage(ch);
-				val = rescale(val, 0.1f, 2.f, 0.f, 1.f);//obey voltage stadards for triggers
-				if(resetTrigger[in][ch].process(val))
-					reset();		
+			uint16_t rising = resetTriggers[in].process(&inputs[RESET_INPUT+in]);
+			if(not rising)
+				continue;
+			//a poly reset restarts just its own channels in independent channels mode
+			if(channelMode && inputs[RESET_INPUT+in].isPolyphonic())
+				resetRequest |= rising;
+			else
+				resetRequest = 0xFFFF;		
+		}
+
+		if(fromRight)
+			resetRequest |= fromRight->resetRequest;
+		processResets(fromLeft, toLeft, toRight);
+
+		updateBoundaries();
+
+		//seek when the step on the seek input changes, after any reset.
+		//a poly seek input moves each channel by itself in independent channels mode.
+		//the first reading after a cable is plugged in, or a patch is loaded, is only taken as the start
+		Input* seekInput = &inputs[SEEK_INPUT];
+		int seekChannels = seekInput->isConnected() ? seekInput->getChannels() : 0;
+		if(not channelMode)
+			seekChannels = std::min(seekChannels, 1);
+		for(int c = 0; c < 16; c++){
+			if(c >= seekChannels){
+				seekSteps[c] = -1;
+				continue;
 			}
+			int step = std::max((int) roundf(seekInput->getVoltage(c) / STEP_VOLTAGE), 0);
+			if(seekSteps[c] < 0){
+				seekSteps[c] = step;
+				continue;
+			}
+			if(step == seekSteps[c])
+				continue;
+			seekSteps[c] = step;
+			seek(step, seekInput->isPolyphonic() ? 1 << c : 0xFFFF);
+		}
+
+		processStepOutput();
+
+		if(toLeft){
+			toLeft->chainLength = chainLength;
+			toLeft->accepting = not stages[0].input->isConnected();
+			leftExpander.module->rightExpander.messageFlipRequested = true;
+		}
+		if(toRight){
+			sendGates(toRight, passRight);
+			rightExpander.module->leftExpander.messageFlipRequested = true;
 		}
 
     }	
 
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "independentChannels", json_boolean(independentChannels));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* independentChannelsJ = json_object_get(rootJ, "independentChannels");
+		if (independentChannelsJ)
+			independentChannels = json_boolean_value(independentChannelsJ);
+	}
+
 };
 
 
@@ -238,6 +632,14 @@ struct Readout : TransparentWidget{
 };
 
 
+struct IndependentChannelsItem : MenuItem {
+	Nexus* module;
+	void onAction(const event::Action& e) override {
+		module->independentChannels ^= true;
+	}
+};
+
+
 struct NexusWidget : ModuleWidget {
 	LightWidget *knobLights[NUM_STAGES];
 
@@ -298,9 +700,26 @@ struct NexusWidget : ModuleWidget {
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(x - 10, y)), module, Nexus::RESET_INPUT+1));					
 		addParam(createParamCentered<PushButtonMomentaryLarge>(mm2px(Vec(x, y)), module, Nexus::RESET_PARAM));
 
+		y -= 7.5;
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(x - 5.4, y)), module, Nexus::SEEK_INPUT));
+		addOutput(createOutputCentered<RoundJackOut>(mm2px(Vec(x + 5.4, y)), module, Nexus::STEP_OUTPUT));
+
 	
 	}
 
+	void appendContextMenu(Menu* menu) override {
+		Nexus* module = dynamic_cast<Nexus*>(this->module);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(new MenuSeparator());
+
+		IndependentChannelsItem* independentChannelsItem = new IndependentChannelsItem;
+		independentChannelsItem->text = "Independent channels";
+		independentChannelsItem->rightText = CHECKMARK(module->independentChannels);
+		independentChannelsItem->module = module;
+		menu->addChild(independentChannelsItem);
+	}
+
 };
 
 Model* modelNexus = createModel<Nexus, NexusWidget>("Nexus");
@@ -1,4 +1,196 @@
 #include "plugin.hpp"
+#include <osdialog.h>
+#include <fstream>
+#include <thread>
+
+static const char* const MODE_NAMES[NUM_MODES] = {"Chrom", "Major", "Minor", "Harm", "Pent", "m Pent", "Whole"};
+
+//frequency of 0V
+const double C4_FREQ = 261.6256;
+//slices of a tuning's period in its search index
+const int TUNING_INDEX_SIZE = 256;
+
+//next line of a scala file that isn't a comment, false at the end of the file
+static bool readScalaLine(std::ifstream& file, std::string& line){
+	while(std::getline(file, line)){
+		if(not line.empty() && line.back() == '\r')
+			line.pop_back();
+		if(line.empty() || line[0] != '!')
+			return true;
+	}
+	return false;
+}
+
+//a pitch line of a .scl file, in cents or as a ratio
+static bool parseScalaPitch(const std::string& line, double* cents){
+	size_t start = line.find_first_not_of(" \t");
+	if(start == std::string::npos)
+		return false;
+	std::string s = line.substr(start);
+	s = s.substr(0, s.find_first_of(" \t"));
+	if(s.find('.') != std::string::npos){
+		*cents = std::atof(s.c_str());
+		return true;
+	}
+	long num = 0, den = 1;
+	size_t slash = s.find('/');
+	num = std::atol(s.substr(0, slash).c_str());
+	if(slash != std::string::npos)
+		den = std::atol(s.substr(slash + 1).c_str());
+	if(num <= 0 || den <= 0)
+		return false;
+	*cents = 1200.0 * std::log2((double) num / den);
+	return true;
+}
+
+//a scala scale and keyboard mapping compiled for quantizing.
+//built off the audio thread and never changed once the engine has it
+struct Tuning{
+	//1V/oct: pitch of scale degree 0 and the period the notes repeat at
+	float offset = 0.f;
+	float period = 1.f;
+	//notes of one period from 0, sorted, with the neighbouring periods' closest notes at either end.
+	//boundaries[i] is where notes[i] gives way to notes[i+1]
+	std::vector<float> notes;
+	std::vector<float> boundaries;
+	//first note of each slice of the period, and the most boundaries within one slice
+	int index[TUNING_INDEX_SIZE];
+	int maxPerSlice = 0;
+
+	//empty when no scala scale is loaded
+	bool active() const {
+		return not notes.empty();
+	}
+
+	bool load(const std::string& sclPath, const std::string& kbmPath){
+		std::ifstream scl(sclPath);
+		std::string line;
+		//description, then the number of notes
+		if(not readScalaLine(scl, line) || not readScalaLine(scl, line))
+			return false;
+		int size = std::atoi(line.c_str());
+		if(size <= 0)
+			return false;
+		//cents of every degree, degree size is the period
+		std::vector<double> degrees = {0.0};
+		for(int i = 0; i < size; i++){
+			double cents;
+			if(not readScalaLine(scl, line) || not parseScalaPitch(line, &cents))
+				return false;
+			degrees.push_back(cents);
+		}
+
+		//without a keyboard mapping degree 0 sits at 0V
+		std::vector<int> mapping;
+		int middleNote = 60;
+		int referenceNote = 60;
+		double referenceFreq = C4_FREQ;
+		int octaveDegree = size;
+		if(not kbmPath.empty()){
+			std::ifstream kbm(kbmPath);
+			//size, first note, last note, middle note, reference note, reference frequency, octave degree
+			int header[7];
+			for(int i = 0; i < 7; i++){
+				if(not readScalaLine(kbm, line))
+					return false;
+				header[i] = std::atoi(line.c_str());
+				if(i == 5)
+					referenceFreq = std::atof(line.c_str());
+			}
+			middleNote = header[3];
+			referenceNote = header[4];
+			if(header[6] > 0)
+				octaveDegree = header[6];
+			for(int i = 0; i < header[0]; i++){
+				if(not readScalaLine(kbm, line))
+					return false;
+				//unmapped keys are -1
+				mapping.push_back(line.find('x') != std::string::npos ? -1 : std::max(std::atoi(line.c_str()), -1));
+			}
+		}
+		if(mapping.empty()){
+			for(int i = 0; i < size; i++)
+				mapping.push_back(i);
+		}
+		if(octaveDegree > size || referenceFreq <= 0.0)
+			return false;
+
+		auto degreeCents = [&](int degree){
+			return (degree / size) * degrees[size] + degrees[degree % size];
+		};
+		double periodCents = degrees[octaveDegree];
+		if(periodCents <= 0.0)
+			return false;
+
+		//tune degree 0 so the reference note lands on the reference frequency
+		int keys = mapping.size();
+		int key = referenceNote - middleNote;
+		int keyOctave = (int) std::floor((double) key / keys);
+		int referenceDegree = mapping[key - keyOctave * keys];
+		double referenceCents = keyOctave * periodCents + (referenceDegree >= 0 ? degreeCents(referenceDegree) : 0.0);
+		offset = std::log2(referenceFreq / C4_FREQ) - referenceCents / 1200.0;
+		period = periodCents / 1200.0;
+
+		std::vector<float> pitches;
+		for(int degree : mapping){
+			if(degree < 0)
+				continue;
+			double cents = std::fmod(degreeCents(degree), periodCents);
+			if(cents < 0.0)
+				cents += periodCents;
+			pitches.push_back(cents / 1200.0);
+		}
+		std::sort(pitches.begin(), pitches.end());
+		pitches.erase(std::unique(pitches.begin(), pitches.end()), pitches.end());
+		if(pitches.empty())
+			return false;
+
+		notes.clear();
+		notes.push_back(pitches.back() - period);
+		notes.insert(notes.end(), pitches.begin(), pitches.end());
+		notes.push_back(pitches.front() + period);
+		compileIndex();
+		return true;
+	}
+
+	void compileIndex(){
+		boundaries.clear();
+		for(size_t i = 0; i + 1 < notes.size(); i++)
+			boundaries.push_back((notes[i] + notes[i+1]) / 2.f);
+		maxPerSlice = 0;
+		size_t b = 0;
+		for(int slice = 0; slice < TUNING_INDEX_SIZE; slice++){
+			float start = period * slice / TUNING_INDEX_SIZE;
+			float end = period * (slice + 1) / TUNING_INDEX_SIZE;
+			while(b < boundaries.size() && boundaries[b] <= start)
+				b++;
+			index[slice] = b;
+			size_t e = b;
+			while(e < boundaries.size() && boundaries[e] <= end)
+				e++;
+			maxPerSlice = std::max(maxPerSlice, (int) (e - b));
+		}
+		//padding, so the search never reads past the end
+		for(int i = 0; i < maxPerSlice; i++)
+			boundaries.push_back(INFINITY);
+	}
+
+	//1V/oct in and out. only compares against the boundaries of one slice
+	float quantize(float v) const {
+		float x = v - offset;
+		float p = std::floor(x / period);
+		x -= p * period;
+		int slice = clamp((int) (x / period * TUNING_INDEX_SIZE), 0, TUNING_INDEX_SIZE - 1);
+		int i = index[slice];
+		for(int k = 0; k < maxPerSlice; k++)
+			i += x >= boundaries[i];
+		return offset + p * period + notes[i];
+	}
+
+	simd::float_4 quantize(simd::float_4 v) const {
+		return simd::float_4(quantize(v[0]), quantize(v[1]), quantize(v[2]), quantize(v[3]));
+	}
+};
 
 struct Quantizer : Module {
 	enum ParamIds {
@@ -26,18 +218,75 @@ struct Quantizer : Module {
 	float rootKnobPrevPos = 0.f;
 	float root = 0.5f;
 
+	//nearest note lookup for the current root and mode, rebuilt when either changes
+	ScaleTable scaleTable;
+	int tableRoot = -1;
+	int tableMode = -1;
+
+	//scala tuning, replaces the mode's scale while active. only the engine touches tuning,
+	//new ones arrive through pendingTuning and the ones they replace go to the ui to be freed
+	Tuning* tuning = nullptr;
+	std::atomic<Tuning*> pendingTuning{nullptr};
+	SpscQueue<Tuning*, 16> retiredTunings;
+	//parses and compiles scala files, so the engine never waits for them
+	std::thread loader;
+	//ui thread only
+	std::string sclPath;
+	std::string kbmPath;
+
+	//cents the input has to go past a note boundary before the note changes
+	float hysteresis = 10.f;
+	//the note each channel is on, and what's left of its trig
+	simd::float_4 notes[4] = {};
+	simd::float_4 trigTimes[4] = {};
+	//channels the notes are known for, ones past it start on their note without a trig
+	int noteChannels = 0;
+
 	Quantizer() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		//configParam(ROOT_PARAM, 0, 11, 6, "Root", "", 0.f, 1.f, 1.f);
 		configParam(ROOT_PARAM, -INFINITY, INFINITY, 0.f, "Root");
-		configParam(MODE_PARAM, 0, 6, 1, "Mode", "", 0.f, 1.f, 1.f);
+		configParam(MODE_PARAM, 0, NUM_MODES - 1, 1, "Mode", "", 0.f, 1.f, 1.f);
+	}
+
+	~Quantizer(){
+		if(loader.joinable())
+			loader.join();
+		delete pendingTuning.exchange(nullptr);
+		delete tuning;
+		freeRetiredTunings();
+	}
+
+	//call from the ui thread. empty sclPath goes back to the mode's scale.
+	//a file that doesn't load leaves the current tuning in place
+	void loadTuning(std::string scl, std::string kbm){
+		sclPath = scl;
+		kbmPath = kbm;
+		if(loader.joinable())
+			loader.join();
+		loader = std::thread([this, scl, kbm](){
+			Tuning* t = new Tuning;
+			if(not scl.empty() && not t->load(scl, kbm)){
+				WARN("Quantizer could not load scala tuning %s %s", scl.c_str(), kbm.c_str());
+				delete t;
+				return;
+			}
+			//one the engine hasn't picked up yet was never used
+			delete pendingTuning.exchange(t);
+		});
 	}
 
+	void freeRetiredTunings(){
+		Tuning* t;
+		while(retiredTunings.pop(t))
+			delete t;
+	}
+
+	//pitch class 0-11, C is 0
 	int getRoot(){		
 		if(inputs[ROOT_INPUT].isConnected()){
-			float in = inputs[ROOT_INPUT].getVoltage() * 12;
-			while(in < 0){ in += 120000; }  //adding 12s until positive so modulo behaves correctly
-			return (int)in % 12;
+			int note = (int) roundf(inputs[ROOT_INPUT].getVoltage() * 12);
+			return ((note % 12) + 12) % 12;
 		}
 		else{
 			return (int)root % 12;
@@ -45,27 +294,130 @@ struct Quantizer : Module {
 
 	}
 
+	//0-10V covers the modes, like Network's scene input
+	int getMode(){
+		if(inputs[MODE_INPUT].isConnected()){
+			int mode = (int) (inputs[MODE_INPUT].getVoltage() / 10.f * NUM_MODES);
+			return clamp(mode, 0, NUM_MODES - 1);
+		}
+		return clamp((int) params[MODE_PARAM].getValue(), 0, NUM_MODES - 1);
+	}
+
+	void updateScaleTable(){
+		int r = getRoot();
+		int mode = getMode();
+		if(r == tableRoot && mode == tableMode)
+			return;
+		tableRoot = r;
+		tableMode = mode;
+		scaleTable.build(getScaleNotes(r, mode));
+	}
+
 
 	void process(const ProcessArgs& args) override {
 
 		if(inputs[ROOT_INPUT].isConnected() == false){
 			root += (params[ROOT_PARAM].getValue() - rootKnobPrevPos) / 2.4f * 12;//why these numbers? good question
 			//keep in sensible range, stay positive for modulo
-			while(root >= 12){ root -= 12; } 
-			while(root < 0){ root += 12; } 
+			root -= floorf(root / 12) * 12;
 			rootKnobPrevPos = params[ROOT_PARAM].getValue();
 		}
-		outputs[CV_OUTPUT].setVoltage(getRoot());
-		outputs[TRIG_OUTPUT].setVoltage(root);
+
+		//a newly loaded tuning takes over on this sample. if the ui is too far behind
+		//to free the old one it's leaked, rather than freed on the audio thread
+		Tuning* t = pendingTuning.exchange(nullptr);
+		if(t){
+			if(tuning)
+				retiredTunings.push(tuning);
+			tuning = t;
+		}
+
+		int channels = inputs[CV_INPUT].getChannels();
+		outputs[CV_OUTPUT].setChannels(channels);
+		outputs[TRIG_OUTPUT].setChannels(channels);
+
+		bool scala = tuning && tuning->active();
+		//the root transposes a scala tuning
+		float r = getRoot() / 12.f;
+		if(not scala)
+			updateScaleTable();
+		float band = hysteresis / 1200.f;
+
+		auto quantize = [&](simd::float_4 v){
+			return scala ? tuning->quantize(v - r) + r : scaleTable.process(v);
+		};
+
+		//every channel on the first sample, and any added since
+		uint32_t newChannels = (0xFFFFu << noteChannels) & ((1u << channels) - 1);
+		noteChannels = channels;
+
+		for(int c = 0; c < channels; c += 4){
+			int b = c / 4;
+			simd::float_4 v = inputs[CV_INPUT].getVoltageSimd<simd::float_4>(c);
+			simd::float_4 note = quantize(v);
+			if(newChannels >> c & 0xF){
+				simd::float_4 added = laneMask(newChannels >> c);
+				notes[b] = simd::ifelse(added, note, notes[b]);
+				trigTimes[b] = simd::ifelse(added, 0.f, trigTimes[b]);
+			}
+			simd::float_4 changed = note != notes[b];
+			if(simd::movemask(changed)){
+				//stay on the current note while the input is within the band past the boundary
+				//it shares with the new one. only for neighbours, a jump further always moves,
+				//and so does a note no longer in the scale
+				simd::float_4 held = notes[b];
+				simd::float_4 boundary = (note + held) * 0.5f;
+				simd::float_4 between = quantize(boundary);
+				simd::float_4 neighbours = (between == note) | (between == held);
+				simd::float_4 keep = (quantize(held) == held) & neighbours & (simd::abs(v - boundary) < band);
+				note = simd::ifelse(keep, held, note);
+				changed = note != held;
+			}
+			notes[b] = note;
+			trigTimes[b] = simd::ifelse(changed, 1e-3f, trigTimes[b] - args.sampleTime);
+
+			outputs[CV_OUTPUT].setVoltageSimd(note, c);
+			outputs[TRIG_OUTPUT].setVoltageSimd(simd::ifelse(trigTimes[b] > 0.f, 10.f, 0.f), c);
+		}
 		
 	}
 	
 	void onRandomize() override {
 		root = (random::u32() % 12) + 0.5f;
+		rootKnobPrevPos = params[ROOT_PARAM].getValue();
 	}
 
 	void onReset() override {
 		root = 0.5f;
+		rootKnobPrevPos = params[ROOT_PARAM].getValue();
+	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "root", json_real(root));
+		json_object_set_new(rootJ, "rootKnobPrevPos", json_real(rootKnobPrevPos));
+		json_object_set_new(rootJ, "sclPath", json_string(sclPath.c_str()));
+		json_object_set_new(rootJ, "kbmPath", json_string(kbmPath.c_str()));
+		json_object_set_new(rootJ, "hysteresis", json_real(hysteresis));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* rootNoteJ = json_object_get(rootJ, "root");
+		if (rootNoteJ)
+			root = json_number_value(rootNoteJ);
+		json_t* prevPosJ = json_object_get(rootJ, "rootKnobPrevPos");
+		if (prevPosJ)
+			rootKnobPrevPos = json_number_value(prevPosJ);
+		json_t* hysteresisJ = json_object_get(rootJ, "hysteresis");
+		if (hysteresisJ)
+			hysteresis = json_number_value(hysteresisJ);
+		const char* sclC = json_string_value(json_object_get(rootJ, "sclPath"));
+		const char* kbmC = json_string_value(json_object_get(rootJ, "kbmPath"));
+		std::string scl = sclC ? sclC : "";
+		std::string kbm = kbmC ? kbmC : "";
+		if(scl != sclPath || kbm != kbmPath)
+			loadTuning(scl, kbm);
 	}
 
 
@@ -86,7 +438,61 @@ struct CenteredLabel : Widget {
 	}
 };
 
+struct LoadScalaItem : MenuItem {
+	Quantizer* module;
+	//.kbm instead of .scl
+	bool mapping = false;
+	void onAction(const event::Action& e) override {
+		osdialog_filters* filters = osdialog_filters_parse(mapping ? "Scala keyboard mapping:kbm" : "Scala scale:scl");
+		char* pathC = osdialog_file(OSDIALOG_OPEN, NULL, NULL, filters);
+		osdialog_filters_free(filters);
+		if (!pathC)
+			return;
+		std::string path = pathC;
+		std::free(pathC);
+
+		if(mapping)
+			module->loadTuning(module->sclPath, path);
+		else
+			module->loadTuning(path, module->kbmPath);
+	}
+};
+
+struct ClearScalaItem : MenuItem {
+	Quantizer* module;
+	void onAction(const event::Action& e) override {
+		module->loadTuning("", "");
+	}
+};
+
+struct HysteresisValueItem : MenuItem {
+	Quantizer* module;
+	float hysteresis;
+	void onAction(const event::Action& e) override {
+		module->hysteresis = hysteresis;
+	}
+};
+
+struct HysteresisItem : MenuItem {
+	Quantizer* module;
+	Menu* createChildMenu() override {
+		Menu* menu = new Menu;
+		for (int cents : {0, 5, 10, 25, 50}) {
+			HysteresisValueItem* item = new HysteresisValueItem;
+			item->text = cents ? string::f("%d cents", cents) : "Off";
+			item->rightText = CHECKMARK(module->hysteresis == cents);
+			item->module = module;
+			item->hysteresis = cents;
+			menu->addChild(item);
+		}
+		return menu;
+	}
+};
+
 struct QuantizerWidget : ModuleWidget {
+	CenteredLabel* rootLabel;
+	CenteredLabel* modeLabel;
+
 	QuantizerWidget(Quantizer* module) {
 		setModule(module);
 		setPanel(APP->window->loadSvg(asset::plugin(pluginInstance, "res/Quantizer.svg")));
@@ -96,18 +502,18 @@ struct QuantizerWidget : ModuleWidget {
 		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 		addChild(createWidget<ScrewSilver>(Vec(box.size.x - 2 * RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
 
-		CenteredLabel* const rootLabel = new CenteredLabel;
+		rootLabel = new CenteredLabel;
 		rootLabel->box.pos = Vec(15, 22);
-		rootLabel->text = "Root here";
+		rootLabel->text = "C";
 		addChild(rootLabel);
 		
 
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(10.17, 23)), module, Quantizer::ROOT_PARAM));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(10.17, 33)), module, Quantizer::ROOT_INPUT));
 
-		CenteredLabel* const modeLabel = new CenteredLabel;
+		modeLabel = new CenteredLabel;
 		modeLabel->box.pos = Vec(15, 70);
-		modeLabel->text = "Mode here";
+		modeLabel->text = MODE_NAMES[1];
 		addChild(modeLabel);
 
 		auto k = createParamCentered<RoundBlackKnob>(mm2px(Vec(10.17, 55)), module, Quantizer::MODE_PARAM);
@@ -121,22 +527,49 @@ struct QuantizerWidget : ModuleWidget {
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(6.251-.5f, 93)), module, Quantizer::TRIG_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(14.089+.5f, 93)), module, Quantizer::CV_OUTPUT));
 
-		addParam(createParamCentered<Trimpot>(mm2px(Vec(10.17, 100)), module, Quantizer::TEST_PARAM));
+	}
 
+	void step() override {
+		Quantizer* module = dynamic_cast<Quantizer*>(this->module);
+		if(module){
+			rootLabel->text = NOTE_NAMES[module->getRoot()];
+			modeLabel->text = module->sclPath.empty() ? MODE_NAMES[module->getMode()] : "Scala";
+			module->freeRetiredTunings();
+		}
+		ModuleWidget::step();
 	}
 
-};
+	void appendContextMenu(Menu* menu) override {
+		Quantizer* module = dynamic_cast<Quantizer*>(this->module);
+
+		menu->addChild(new MenuEntry);
+		menu->addChild(new MenuSeparator());
 
-// void QuantizerWidget::appendContextMenu(Menu *menu) {
-// 	Quantizer *quantizer = dynamic_cast<quantizer*>(module);
-// 	menu->addChild(new MenuSeparator());
+		HysteresisItem* hysteresisItem = new HysteresisItem;
+		hysteresisItem->text = "Hysteresis";
+		hysteresisItem->rightText = string::f("%d cents", (int) module->hysteresis) + " " + RIGHT_ARROW;
+		hysteresisItem->module = module;
+		menu->addChild(hysteresisItem);
 
-// 	// NSChannelItem *channelItem = new NSChannelItem;
-// 	// channelItem->text = "Polyphony channels";
-// 	// channelItem->rightText = string::f("%d", noteSeq->channels) + " " +RIGHT_ARROW;
-// 	// channelItem->module = noteSeq;
-// 	// menu->addChild(channelItem);
-// }
+		LoadScalaItem* sclItem = new LoadScalaItem;
+		sclItem->text = "Load Scala scale";
+		sclItem->rightText = string::filename(module->sclPath);
+		sclItem->module = module;
+		menu->addChild(sclItem);
 
+		LoadScalaItem* kbmItem = new LoadScalaItem;
+		kbmItem->text = "Load Scala keyboard mapping";
+		kbmItem->rightText = string::filename(module->kbmPath);
+		kbmItem->module = module;
+		kbmItem->mapping = true;
+		menu->addChild(kbmItem);
+
+		ClearScalaItem* clearItem = new ClearScalaItem;
+		clearItem->text = "Clear Scala tuning";
+		clearItem->module = module;
+		menu->addChild(clearItem);
+	}
+
+};
 
 Model* modelQuantizer = createModel<Quantizer, QuantizerWidget>("Quantizer");
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+
+using namespace rack;
+
+//expand the low 4 bits of a channel mask into float_4 lane masks
+inline simd::float_4 laneMask(uint32_t bits){
+	return simd::float_4(bits & 1, bits & 2, bits & 4, bits & 8) != 0.f;
+}
+
+// Bank of 16 schmitt triggers, processed 4 channels at a time.
+// Results are returned as bitfields, one bit per channel.
+// Only the blocks covering the input's actual channels are processed;
+// unpatched inputs cost nothing once their triggers have fallen.
+struct TriggerBank {
+	dsp::TSchmittTrigger<simd::float_4> triggers[4];
+	//schmitt triggers start high, so they don't fire on the first sample
+	uint16_t highMask = 0xFFFF;
+	int numBlocks = 4;
+
+	//returns mask of channels that rose this sample.
+	//a null input reads 0V, like an unpatched one, as do channels outside mask
+	uint16_t process(Input* input, uint16_t mask = 0xFFFF){
+		int blocks = input && input->isConnected() ? (input->getChannels() + 3) / 4 : 0;
+
+		//channels no longer present read 0V, so their triggers just fall
+		for(int b = blocks; b < numBlocks; b++)
+			triggers[b].state = simd::float_4::zero();
+		numBlocks = blocks;
+
+		if(blocks == 0){
+			highMask = 0;
+			return 0;
+		}
+
+		uint16_t rising = 0;
+		uint16_t high = 0;
+		for(int c = 0; c < blocks * 4; c += 4){
+			simd::float_4 val = input->getVoltageSimd<simd::float_4>(c);
+			if((mask >> c & 0xF) != 0xF)
+				val = simd::ifelse(laneMask(mask >> c), val, 0.f);
+			val = (val - 0.1f) / (2.f - 0.1f);//obey voltage stadards for triggers
+			rising |= simd::movemask(triggers[c/4].process(val)) << c;
+			high |= simd::movemask(triggers[c/4].isHigh()) << c;
+		}
+		highMask = high;
+		return rising;
+	}
+
+	bool anyHigh(){
+		return highMask != 0;
+	}
+
+	//drop the triggers of the channels in mask low, their next high input fires
+	void reset(uint16_t mask = 0xFFFF){
+		for(int b = 0; b < 4; b++)
+			triggers[b].state = simd::ifelse(laneMask(mask >> (b * 4)), 0.f, triggers[b].state);
+		highMask &= ~mask;
+	}
+
+	//take over the trigger states of the channels in mask from a bank watching the same gates
+	void copy(const TriggerBank& from, uint16_t mask = 0xFFFF){
+		for(int b = 0; b < 4; b++)
+			triggers[b].state = simd::ifelse(laneMask(mask >> (b * 4)), from.triggers[b].state, triggers[b].state);
+		highMask = (highMask & ~mask) | (from.highMask & mask);
+	}
+};
+
+// Scales shared by Quantizer and Network's cv quantizing
+const int NUM_MODES = 7;
+
+//scales by mode, bit 0 is the root
+static const uint16_t MODE_NOTES[NUM_MODES] = {
+	0xFFF,//chromatic
+	0xAB5,//major
+	0x5AD,//natural minor
+	0x9AD,//harmonic minor
+	0x295,//major pentatonic
+	0x4A9,//minor pentatonic
+	0x555 //whole tone
+};
+
+static const char* const NOTE_NAMES[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+
+//pitch classes of a mode moved up to a root, bit 0 is C
+inline uint16_t getScaleNotes(int root, int mode){
+	uint32_t notes = (uint32_t) MODE_NOTES[mode] << root;
+	return (notes | notes >> 12) & 0xFFF;
+}
+
+// Nearest note lookup for a scale of 12 tone equal temperament.
+// Boundaries between neighbouring notes always fall on a half semitone,
+// so a table of one octave of half semitone bins quantizes exactly.
+// Build when the scale changes, process is branch free.
+struct ScaleTable {
+	//pitch classes in the scale, bit 0 is C. never empty
+	uint16_t notes = 0xFFF;
+	//note each bin quantizes to, in semitones from the bin's octave.
+	//bins at the edges of the octave may go to a neighbouring octave's note
+	float bins[24];
+
+	ScaleTable(){
+		build(0xFFF);
+	}
+
+	//an empty scale quantizes chromatically
+	void build(uint16_t _notes){
+		notes = (_notes & 0xFFF) ? (_notes & 0xFFF) : 0xFFF;
+		for(int b = 0; b < 24; b++){
+			float centre = b * 0.5f + 0.25f;
+			int best = 0;
+			float bestDistance = INFINITY;
+			for(int n = -12; n < 24; n++){
+				float distance = std::fabs(n - centre);
+				if((notes >> ((n + 12) % 12) & 1) && distance < bestDistance){
+					best = n;
+					bestDistance = distance;
+				}
+			}
+			bins[b] = best;
+		}
+	}
+
+	//1V/oct in and out
+	simd::float_4 process(simd::float_4 v){
+		simd::float_4 x = simd::floor(v * 24.f);
+		simd::float_4 octave = simd::floor(x / 24.f);
+		simd::float_4 bin = simd::clamp(x - octave * 24.f, 0.f, 23.f);
+		simd::float_4 note(bins[(int) bin[0]], bins[(int) bin[1]], bins[(int) bin[2]], bins[(int) bin[3]]);
+		return octave + note / 12.f;
+	}
+};
+
+// Lock-free queue for exactly one producer thread and one consumer thread,
+// e.g. ui to engine. S must be a power of 2.
+template <typename T, size_t S>
+struct SpscQueue {
+	T data[S];
+	std::atomic<size_t> start{0};
+	std::atomic<size_t> end{0};
+
+	//returns false if the queue is full
+	bool push(const T& t){
+		size_t e = end.load(std::memory_order_relaxed);
+		if(e - start.load(std::memory_order_acquire) >= S)
+			return false;
+		data[e % S] = t;
+		end.store(e + 1, std::memory_order_release);
+		return true;
+	}
+
+	//returns false if the queue is empty
+	bool pop(T& t){
+		size_t s = start.load(std::memory_order_relaxed);
+		if(s == end.load(std::memory_order_acquire))
+			return false;
+		t = data[s % S];
+		start.store(s + 1, std::memory_order_release);
+		return true;
+	}
+};
@@ -9,8 +9,10 @@ void init(Plugin* p) {
 
 	// Add modules here
 	// p->addModel(modelMyModule);
-	//p->addModel(modelQuantizer);
+	p->addModel(modelQuantizer);
 	p->addModel(modelNetwork);
+	p->addModel(modelNetwork4x2);
+	p->addModel(modelNetwork4x8);
 	p->addModel(modelNexus);
 	// Any other plugin initialization may go here.
 	// As an alternative, consider lazy-loading assets and lookup tables when your module is created to reduce startup times of Rack.
@@ -1,6 +1,7 @@
 #pragma once
 #include <rack.hpp>
 #include "mog_components.hpp"
+#include "mog_dsp.hpp"
 
 // Explicit <array> include required on OS X
 #include <array> 
@@ -13,8 +14,10 @@ extern Plugin* pluginInstance;
 
 // Declare each Model, defined in each module source file
 // extern Model* modelMyModule;
-//extern Model* modelQuantizer;
+extern Model* modelQuantizer;
 extern Model* modelNetwork;
+extern Model* modelNetwork4x2;
+extern Model* modelNetwork4x8;
 
 extern Model* modelNexus;
 